@@ -1,8 +1,14 @@
 #include <WiFi.h>
 #include <WebServer.h>
+#include <esp_timer.h>
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
+
+#include <atomic>
 
 #include <Wire.h>
 #include <RTClib.h>
+#include <Preferences.h>
 #include <DHT.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
@@ -11,293 +17,3914 @@
 const char* ap_ssid="ESP32-FARM";
 const char* ap_pass="12345678";
 
-WebServer server(80);
+// 농장 공유기 (비워 두면 AP 전용)
+const char* sta_ssid="";
+const char* sta_pass="";
+
+WebServer server(80);
+
+// ---------------- 릴레이 ----------------
+#define RELAY_ON HIGH
+#define RELAY_OFF LOW
+
+// ---------------- 핀 ----------------
+#define DHTPIN 13
+#define DHTTYPE DHT11
+#define ONE_WIRE_BUS 27
+
+#define RELAY_HEATER 14
+#define RELAY_FAN 25
+#define RELAY_LED 26
+#define RELAY_PUMP 33
+
+// ---------------- 릴레이 드라이버 ----------------
+// 핀과 ON 레벨을 템플릿 인자로 고정한다. 극성 판단은 컴파일 시 끝난다.
+template<uint8_t PIN,uint8_t ACTIVE>
+struct Relay
+{
+ static const uint8_t pin=PIN;
+ static const uint8_t bank=PIN>>5;           // 0: GPIO0~31, 1: GPIO32~39
+ static const uint32_t mask=1UL<<(PIN&31);
+
+ static void init(){pinMode(PIN,OUTPUT);}
+
+ // 릴레이 ON/OFF 가 핀 HIGH 인지
+ static bool level(bool on){return on?ACTIVE==HIGH:ACTIVE!=HIGH;}
+};
+
+typedef Relay<RELAY_HEATER,RELAY_ON> HeaterRelay;
+typedef Relay<RELAY_FAN,RELAY_ON> FanRelay;
+typedef Relay<RELAY_LED,RELAY_ON> LedRelay;
+typedef Relay<RELAY_PUMP,RELAY_ON> PumpRelay;
+
+// 한 tick 동안 바뀐 릴레이를 모았다가 flush() 에서 뱅크별 W1TS/W1TC 한 번씩으로 내보낸다.
+// 각 레지스터 쓰기는 원자적이라 read-modify-write 경합이 없다.
+struct RelayBank
+{
+ uint32_t setMask[2];
+ uint32_t clrMask[2];
+
+ template<class R> void stage(bool on)
+ {
+  if(R::level(on))
+  {
+   setMask[R::bank]|=R::mask;
+   clrMask[R::bank]&=~R::mask;
+  }
+  else
+  {
+   clrMask[R::bank]|=R::mask;
+   setMask[R::bank]&=~R::mask;
+  }
+ }
+
+ void flush()
+ {
+  if(setMask[0]) REG_WRITE(GPIO_OUT_W1TS_REG,setMask[0]);
+  if(clrMask[0]) REG_WRITE(GPIO_OUT_W1TC_REG,clrMask[0]);
+  if(setMask[1]) REG_WRITE(GPIO_OUT1_W1TS_REG,setMask[1]);
+  if(clrMask[1]) REG_WRITE(GPIO_OUT1_W1TC_REG,clrMask[1]);
+
+  setMask[0]=setMask[1]=0;
+  clrMask[0]=clrMask[1]=0;
+ }
+};
+
+RelayBank relayBank;
+
+// ---------------- 객체 ----------------
+RTC_DS3231 rtc;
+DateTime rtcNow;
+
+DHT dht(DHTPIN,DHTTYPE);
+
+OneWire oneWire(ONE_WIRE_BUS);
+DallasTemperature waterSensor(&oneWire);
+
+Preferences prefs;
+
+// ---------------- 고정소수점 ----------------
+// 센서값은 읽자마자 정수로 바꿔 이후 비교/저장/출력 모두 정수로 처리한다.
+// 온도 0.01C (centi), 습도 0.1% (per-mille), 읽기 실패는 SENSOR_NA.
+typedef int16_t centi_t;
+typedef int16_t permille_t;
+
+const int16_t SENSOR_NA=INT16_MIN;
+
+centi_t toCenti(float v)
+{
+ if(isnan(v) || v<-327.0f || v>327.0f) return SENSOR_NA;
+ return (centi_t)lroundf(v*100.0f);
+}
+
+permille_t toPermille(float v)
+{
+ if(isnan(v) || v<-3276.0f || v>3276.0f) return SENSOR_NA;
+ return (permille_t)lroundf(v*10.0f);
+}
+
+// 수온 센서 유효 범위 (-40~80C, 분리 시 -127C)
+bool waterValid(centi_t w)
+{
+ return w!=SENSOR_NA && w>=-4000 && w<=8000;
+}
+
+// v/10^scale 을 소수 digits 자리로 쓴다 (digits<=scale, 0.5 는 0 에서 먼 쪽으로 반올림).
+// SENSOR_NA 는 "NA". 반환값은 길이.
+int fmtFixed(char *buf,int32_t v,uint8_t scale,uint8_t digits)
+{
+ if(v==SENSOR_NA)
+ {
+  memcpy(buf,"NA",3);
+  return 2;
+ }
+
+ static const uint32_t POW10[]={1,10,100,1000,10000};
+
+ uint32_t u=v<0?-(uint32_t)v:v;
+ uint32_t div=POW10[scale-digits];
+ u=(u+div/2)/div;
+
+ uint32_t ip=u/POW10[digits];
+ uint32_t fp=u%POW10[digits];
+
+ char tmp[12];
+ int n=0;
+ do
+ {
+  tmp[n++]='0'+ip%10;
+  ip/=10;
+ }
+ while(ip);
+
+ char *p=buf;
+ if(v<0 && u) *p++='-';
+ while(n) *p++=tmp[--n];
+
+ if(digits)
+ {
+  *p++='.';
+  for(int i=digits-1;i>=0;i--)
+  {
+   p[i]='0'+fp%10;
+   fp/=10;
+  }
+  p+=digits;
+ }
+
+ *p=0;
+ return p-buf;
+}
+
+// ---------------- 수온 기준 ----------------
+// 0.01C. ON 경계는 고정, OFF 경계는 자동 조정(tune)이 움직일 수 있다.
+const centi_t HEATER_ON=2200;
+const centi_t HEATER_OFF=2250;
+
+const centi_t FAN_ON=2600;
+const centi_t FAN_OFF=2550;
+
+centi_t heaterOffAt=HEATER_OFF;
+centi_t fanOffAt=FAN_OFF;
+
+// ---------------- 상태 ----------------
+bool heaterState=false;
+bool fanState=false;
+bool ledState=false;
+std::atomic<bool> pumpState(false); // 펌프 타이머 콜백이 바꾼다
+
+// ---------------- 펌프 ----------------
+// ON/OFF 경계는 esp_timer 콜백이 절대 마감시각 기준으로 직접 GPIO 를 바꾼다.
+// 다음 마감 = 이전 마감 + 구간 이라 loop() 지연이 누적되지 않는다.
+esp_timer_handle_t pumpTimerHandle=NULL;
+int64_t pumpDeadlineUs=0;
+portMUX_TYPE pumpMux=portMUX_INITIALIZER_UNLOCKED;
+
+std::atomic<uint32_t> pumpEdges(0); // 콜백이 올림, 홀수번째 = ON
+uint32_t pumpEdgesSeen=0;
+
+// const unsigned long PUMP_ON_TIME=1UL*60UL*1000UL; // 1분
+// const unsigned long PUMP_OFF_TIME=3UL*60UL*1000UL; // 3분
+const unsigned long PUMP_ON_TIME=7UL*1000UL; // 7초
+const unsigned long PUMP_OFF_TIME=1UL*60UL*1000UL; // 1분
+
+// ---------------- 로그 타이머 ----------------
+unsigned long lastSensorLog=0;
+unsigned long lastStatusLog=0;
+
+// ---------------- 최근 센서값 ----------------
+centi_t lastAirTemp=SENSOR_NA;
+permille_t lastHum=SENSOR_NA;
+centi_t lastWaterTemp=SENSOR_NA;
+
+// ---------------- 카운터 ----------------
+enum RelayId{RID_HEATER,RID_FAN,RID_LED,RID_PUMP,RID_COUNT};
+const char* const RELAY_NAMES[RID_COUNT]={"heater","fan","led","pump"};
+
+unsigned long relayTransitions[RID_COUNT]={0};
+
+unsigned long dhtErrors=0;
+unsigned long waterErrors=0;
+
+// loop() 소요시간 히스토그램 (us, 누적은 출력 시 계산)
+const unsigned long LOOP_BUCKETS_US[]={100,500,1000,5000,10000,50000,100000,500000,1000000};
+const int LOOP_BUCKET_COUNT=sizeof(LOOP_BUCKETS_US)/sizeof(LOOP_BUCKETS_US[0]);
+
+unsigned long loopHist[LOOP_BUCKET_COUNT+1]={0};
+unsigned long loopCount=0;
+uint64_t loopSumUs=0;
+
+// ---------------- 메모리 ----------------
+// 30초마다 힙/스택 상태를 기록한다. 단위는 바이트.
+const unsigned long HEAP_SAMPLE_INTERVAL=30000;
+const int HEAP_HISTORY=240; // 2시간
+
+// 단편화(1 - 최대블록/여유힙) 경보, 히스테리시스
+const int HEAP_FRAG_ALERT=50;
+const int HEAP_FRAG_CLEAR=40;
+
+// 스택 high-water mark 를 기록하는 태스크. 아직 없는 태스크는 STACK_NA
+enum StackTask{STK_LOOP,STK_SERIAL,STK_MQTT,STK_COUNT};
+const char* const STACK_TASK_NAMES[STK_COUNT]={"loop","serialTx","mqttConnect"};
+const uint16_t STACK_NA=0xFFFF;
+
+struct HeapSample
+{
+ uint32_t ms;
+ uint32_t freeHeap;
+ uint32_t largest;
+ uint16_t stackFree[STK_COUNT];
+ uint8_t frag;
+};
+
+HeapSample heapHistory[HEAP_HISTORY];
+int heapHead=0;
+int heapCount=0;
+
+unsigned long lastHeapSample=0;
+uint32_t heapMinLargest=0xFFFFFFFF;
+uint16_t stackMinFree[STK_COUNT]={STACK_NA,STACK_NA,STACK_NA};
+bool heapFragAlert=false;
+
+// ---------------- 성능 계측 ----------------
+// PERF_ENABLE 0 으로 빌드하면 계측 코드가 모두 빠진다.
+#ifndef PERF_ENABLE
+#define PERF_ENABLE 1
+#endif
+
+#if PERF_ENABLE
+
+enum PerfId{PERF_CLIENT,PERF_RTC,PERF_PUMP,PERF_LED,PERF_SENSOR,PERF_STATUS,PERF_APPENDLOG,PERF_MQTT,PERF_LOOP,PERF_COUNT};
+const char* const PERF_NAMES[PERF_COUNT]=
+{"handleClient","rtcNow","handlePump","handleLED","sensors","handleStatusLine","appendLog","handleMqtt","loop"};
+
+// 사이클 수 log2 히스토그램: bin b = [2^(b-1), 2^b) cycles
+const int PERF_BINS=33;
+
+struct PerfStat
+{
+ uint32_t hist[PERF_BINS];
+ uint32_t count;
+ uint64_t sum;
+ uint32_t last;
+ uint32_t max;
+ uint32_t maxJitter;
+};
+
+PerfStat perfStats[PERF_COUNT];
+
+// 가장 느렸던 N건 (사이클 내림차순)
+struct PerfWorst
+{
+ uint32_t cycles;
+ uint32_t ms;
+ uint8_t id;
+};
+
+const int PERF_WORST_N=8;
+PerfWorst perfWorst[PERF_WORST_N];
+
+// loop() 호출 간격 흔들림
+uint32_t perfLoopPrevStart=0;
+uint32_t perfLoopPeriod=0;
+uint32_t perfLoopMaxJitter=0;
+
+void perfRecord(int id,uint32_t cycles)
+{
+ PerfStat &p=perfStats[id];
+
+ int bin=cycles?32-__builtin_clz(cycles):0;
+ p.hist[bin]++;
+
+ if(p.count)
+ {
+  uint32_t j=cycles>p.last?cycles-p.last:p.last-cycles;
+  if(j>p.maxJitter) p.maxJitter=j;
+ }
+
+ p.count++;
+ p.sum+=cycles;
+ p.last=cycles;
+ if(cycles>p.max) p.max=cycles;
+
+ if(cycles<=perfWorst[PERF_WORST_N-1].cycles) return;
+
+ int i=PERF_WORST_N-1;
+ while(i>0 && perfWorst[i-1].cycles<cycles)
+ {
+  perfWorst[i]=perfWorst[i-1];
+  i--;
+ }
+
+ perfWorst[i].cycles=cycles;
+ perfWorst[i].ms=millis();
+ perfWorst[i].id=id;
+}
+
+void perfLoopStart(uint32_t now)
+{
+ if(perfLoopPrevStart)
+ {
+  uint32_t period=now-perfLoopPrevStart;
+
+  if(perfLoopPeriod)
+  {
+   uint32_t j=period>perfLoopPeriod?period-perfLoopPeriod:perfLoopPeriod-period;
+   if(j>perfLoopMaxJitter) perfLoopMaxJitter=j;
+  }
+
+  perfLoopPeriod=period;
+ }
+
+ perfLoopPrevStart=now;
+}
+
+void perfReset()
+{
+ memset(perfStats,0,sizeof(perfStats));
+ memset(perfWorst,0,sizeof(perfWorst));
+ perfLoopPrevStart=0;
+ perfLoopPeriod=0;
+ perfLoopMaxJitter=0;
+}
+
+float perfUs(uint64_t cycles)
+{
+ return (float)cycles/ESP.getCpuFreqMHz();
+}
+
+#define PERF_BEGIN(id) uint32_t perfT_##id=ESP.getCycleCount()
+#define PERF_END(id) perfRecord(id,ESP.getCycleCount()-perfT_##id)
+
+#else
+
+#define PERF_BEGIN(id)
+#define PERF_END(id)
+
+#endif
+
+// ---------------- SPSC 링 ----------------
+// 생산자 하나, 소비자 하나인 lock-free 링. head 는 생산자만, tail 은 소비자만 쓰고
+// 상대 쪽 인덱스는 acquire 로 읽는다. 꽉 차면 기다리지 않고 버린 개수를 센다.
+// peak/dropped 는 생산자만 갱신하고 다른 쪽에서는 대략값으로 읽는다.
+template<typename T,uint32_t N>
+class SpscRing
+{
+ static_assert(N && !(N&(N-1)),"SpscRing size must be a power of two");
+
+public:
+ static uint32_t capacity(){return N;}
+
+ // 생산자
+ bool push(const T& v)
+ {
+  return pushAll(&v,1);
+ }
+
+ // a 와 b 를 이어서 전부 넣거나 하나도 넣지 않는다
+ bool pushAll(const T* a,uint32_t na,const T* b=NULL,uint32_t nb=0)
+ {
+  uint32_t head=head_.load(std::memory_order_relaxed);
+  uint32_t used=head-tail_.load(std::memory_order_acquire);
+
+  if(used+na+nb>N)
+  {
+   dropped_+=na+nb;
+   return false;
+  }
+
+  for(uint32_t i=0;i<na;i++) buf_[(head+i)&(N-1)]=a[i];
+  for(uint32_t i=0;i<nb;i++) buf_[(head+na+i)&(N-1)]=b[i];
+
+  used+=na+nb;
+  if(used>peak_) peak_=used;
+
+  head_.store(head+na+nb,std::memory_order_release);
+  return true;
+ }
+
+ // 소비자
+ bool pop(T& v)
+ {
+  const T* p;
+  if(!peek(p)) return false;
+
+  v=*p;
+  consume(1);
+  return true;
+ }
+
+ // 링 끝을 넘지 않는 연속 구간의 길이 (0 이면 비어 있음)
+ uint32_t peek(const T*& p) const
+ {
+  uint32_t tail=tail_.load(std::memory_order_relaxed);
+  uint32_t n=head_.load(std::memory_order_acquire)-tail;
+  uint32_t idx=tail&(N-1);
+
+  if(n>N-idx) n=N-idx;
+  p=&buf_[idx];
+
+  return n;
+ }
+
+ void consume(uint32_t n)
+ {
+  tail_.store(tail_.load(std::memory_order_relaxed)+n,std::memory_order_release);
+ }
+
+ uint32_t depth() const
+ {
+  return head_.load(std::memory_order_acquire)-tail_.load(std::memory_order_acquire);
+ }
+
+ uint32_t peak() const{return peak_;}
+ uint32_t dropped() const{return dropped_;}
+
+private:
+ T buf_[N];
+ std::atomic<uint32_t> head_{0};
+ std::atomic<uint32_t> tail_{0};
+ uint32_t peak_=0;
+ uint32_t dropped_=0;
+};
+
+// ---------------- 시리얼 출력 큐 ----------------
+// appendLog 는 큐에 넣기만 하고 core 0 의 낮은 우선순위 태스크가 UART 로 내보낸다.
+// 생산자(loop)와 소비자(serialTx) 하나씩인 바이트 링. 자리가 없으면 줄 단위로 버린다.
+SpscRing<uint8_t,4096> serialRing;
+
+unsigned long serialDroppedLines=0;
+
+TaskHandle_t serialTaskHandle=NULL;
+
+bool serialEnqueue(const char* text,size_t len)
+{
+ static const uint8_t CRLF[2]={'\r','\n'};
+
+ if(serialRing.pushAll((const uint8_t*)text,len,CRLF,2)) return true;
+
+ serialDroppedLines++;
+ return false;
+}
+
+void serialPrintf(const char* fmt,...)
+{
+ char line[160];
+
+ va_list ap;
+ va_start(ap,fmt);
+ int n=vsnprintf(line,sizeof(line),fmt,ap);
+ va_end(ap);
+
+ if(n<0) return;
+ if(n>=(int)sizeof(line)) n=sizeof(line)-1;
+
+ serialEnqueue(line,n);
+}
+
+void serialDrainTask(void*)
+{
+ for(;;)
+ {
+  const uint8_t* p;
+  uint32_t n=serialRing.peek(p);
+
+  if(!n)
+  {
+   vTaskDelay(pdMS_TO_TICKS(5));
+   continue;
+  }
+
+  // 링 끝을 넘지 않는 연속 구간만, UART TX 버퍼가 받을 만큼 보낸다.
+  int room=Serial.availableForWrite();
+  if(room<=0)
+  {
+   vTaskDelay(pdMS_TO_TICKS(2));
+   continue;
+  }
+  if(n>(uint32_t)room) n=room;
+
+  Serial.write(p,n);
+
+  serialRing.consume(n);
+ }
+}
+
+// ---------------- 로그 버퍼 ----------------
+char logBuffer[12000];
+int logIndex=0;
+
+// ---------------- 로그 태그 인덱스 ----------------
+// 줄을 넣을 때 태그를 한 번 분류해 태그별 링에 (스트림 위치, epoch) 를 남긴다.
+// 스트림 위치는 지금까지 쌓인 전체 바이트 수라서 memmove 로 앞 2000 바이트를 버려도
+// 인덱스를 고칠 필요 없이 logBase 만 올리면 되고, logBase 보다 앞선 항목은 지워진 줄이다.
+enum LogTag{LT_STATUS,LT_SENSOR,LT_HEATER,LT_FAN,LT_LED,LT_PUMP,LT_ALARM,LT_MQTT,LT_HEAP,LT_ERROR,LT_SYSTEM,LT_COUNT};
+const char* const LOG_TAG_NAMES[LT_COUNT]=
+{"STATUS","SENSOR","HEATER","FAN","LED","PUMP","ALARM","MQTT","HEAP","ERROR","SYSTEM"};
+
+const int LOG_INDEX_DEPTH=64;    // 태그별 최근 줄 수 (2의 거듭제곱)
+
+struct LogIndexEntry
+{
+ uint32_t pos;
+ uint32_t epoch;
+};
+
+LogIndexEntry logIndexRing[LT_COUNT][LOG_INDEX_DEPTH];
+uint32_t logIndexCount[LT_COUNT];    // 누적 개수, 링 위치는 % LOG_INDEX_DEPTH
+uint32_t logBase=0;                  // logBuffer[0] 의 스트림 위치
+
+// "[YYYY-MM-DD HH:MM:SS] " 뒤의 첫 토큰으로 분류
+int logTagOf(const char* text,int len)
+{
+ const char* p=text;
+
+ if(len>21 && p[0]=='[' && p[20]==']') p+=22;
+
+ if(p[0]=='[')
+ {
+  const char* e=strchr(p,']');
+  int n=e?e-p-1:0;
+
+  for(int i=0;i<LT_COUNT;i++)
+  if((int)strlen(LOG_TAG_NAMES[i])==n && !strncmp(p+1,LOG_TAG_NAMES[i],n)) return i;
+
+  if((n==5 && !strncmp(p+1,"DHT11",5)) || (n==7 && !strncmp(p+1,"DS18B20",7))) return LT_SENSOR;
+
+  return LT_SYSTEM;
+ }
+
+ if(p[0]=='T' && p[1]=='=') return LT_STATUS;
+ if(!strncmp(p,"SENSOR",6)) return LT_SENSOR;
+
+ return LT_SYSTEM;
+}
+
+void logIndexAdd(int tag,uint32_t pos)
+{
+ LogIndexEntry &e=logIndexRing[tag][logIndexCount[tag]%LOG_INDEX_DEPTH];
+ e.pos=pos;
+ e.epoch=rtcNow.unixtime();
+ logIndexCount[tag]++;
+}
+
+int logTagByName(const String& name)
+{
+ for(int i=0;i<LT_COUNT;i++)
+ if(name.equalsIgnoreCase(LOG_TAG_NAMES[i])) return i;
+
+ return -1;
+}
+
+// ---------------- 시간 문자열 ----------------
+// rtcNow 는 loop 에서 한 번 읽으므로 같은 초 안의 호출은 캐시된 문자열을 그대로 돌려준다.
+// 같은 분 안에서 초만 바뀌면 초 두 자리만 고친다.
+char nowText[20]="0000-00-00 00:00:00";
+uint32_t nowTextEpoch=0;
+bool nowTextValid=false;
+
+char nowEpochText[12]="0";
+uint32_t nowEpochCached=0;
+
+// "YYYY-MM-DD HH:MM:SS"
+const char* nowStr()
+{
+ uint32_t e=rtcNow.unixtime();
+
+ if(nowTextValid && e==nowTextEpoch) return nowText;
+
+ if(nowTextValid && e/60==nowTextEpoch/60)
+ {
+  uint8_t sec=e%60;
+  nowText[17]='0'+sec/10;
+  nowText[18]='0'+sec%10;
+ }
+ else
+ {
+  // 필드마다 자릿수를 묶어 두면 19자 + NUL 에 항상 들어간다 (-Wformat-truncation 도 조용하다)
+  snprintf(nowText,sizeof(nowText),"%04u-%02u-%02u %02u:%02u:%02u",
+  (unsigned)(rtcNow.year()%10000),(unsigned)(rtcNow.month()%100),(unsigned)(rtcNow.day()%100),
+  (unsigned)(rtcNow.hour()%100),(unsigned)(rtcNow.minute()%100),(unsigned)(rtcNow.second()%100));
+ }
+
+ nowTextEpoch=e;
+ nowTextValid=true;
+
+ return nowText;
+}
+
+// 기계용: unixtime 10진수
+const char* nowEpochStr()
+{
+ uint32_t e=rtcNow.unixtime();
+
+ if(e!=nowEpochCached)
+ {
+  snprintf(nowEpochText,sizeof(nowEpochText),"%lu",(unsigned long)e);
+  nowEpochCached=e;
+ }
+
+ return nowEpochText;
+}
+
+// ---------------- 로그 ----------------
+void appendLog(const char* text)
+{
+ PERF_BEGIN(PERF_APPENDLOG);
+
+ int len=strlen(text);
+
+ // 앞 2000 바이트를 버리고 실제로 쓴 부분(logIndex 까지)만 당긴다
+ if(logIndex+len+1>=12000)
+ {
+  memmove(logBuffer,logBuffer+2000,logIndex-2000);
+  logIndex-=2000;
+  logBase+=2000;
+ }
+
+ logIndexAdd(logTagOf(text,len),logBase+logIndex);
+
+ memcpy(&logBuffer[logIndex],text,len);
+ logIndex+=len;
+
+ logBuffer[logIndex++]='\n';
+ logBuffer[logIndex]=0;
+
+ serialEnqueue(text,len);
+
+ PERF_END(PERF_APPENDLOG);
+}
+
+// ---------------- 로그 레벨/카테고리 ----------------
+// LOG_LEVEL_MIN 보다 낮은 레벨은 컴파일 시 조건이 상수 false 가 되어 인자 포맷까지 사라진다.
+// 런타임에는 카테고리 마스크로 거른다. WARN 이상은 마스크와 무관하게 남긴다.
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN LOG_INFO
+#endif
+
+enum LogCat{CAT_SENSOR,CAT_RELAY,CAT_PUMP,CAT_SYSTEM,CAT_COUNT};
+const char* const LOG_CAT_NAMES[CAT_COUNT]={"SENSOR","RELAY","PUMP","SYSTEM"};
+
+#define LOG_MASK_ALL ((1<<CAT_COUNT)-1)
+#define LOG_MASK_PRODUCTION ((1<<CAT_RELAY)|(1<<CAT_PUMP)) // 전환 + 오류만
+
+#ifndef LOG_MASK_DEFAULT
+#define LOG_MASK_DEFAULT LOG_MASK_ALL
+#endif
+
+uint8_t logMask=LOG_MASK_DEFAULT;
+unsigned long logSuppressed=0;
+
+bool logEnabled(int level,int cat)
+{
+ if(level>=LOG_WARN || (logMask&(1<<cat))) return true;
+
+ logSuppressed++;
+ return false;
+}
+
+#define LOG_ON(level,cat) ((level)>=LOG_LEVEL_MIN && logEnabled(level,cat))
+
+#define LOGF(level,cat,...) do{ if(LOG_ON(level,cat)) logPrintf(__VA_ARGS__); }while(0)
+#define LOG_D(cat,...) LOGF(LOG_DEBUG,cat,__VA_ARGS__)
+#define LOG_I(cat,...) LOGF(LOG_INFO,cat,__VA_ARGS__)
+#define LOG_W(cat,...) LOGF(LOG_WARN,cat,__VA_ARGS__)
+#define LOG_E(cat,...) LOGF(LOG_ERROR,cat,__VA_ARGS__)
+
+void logPrintf(const char* fmt,...)
+{
+ char line[200];
+
+ va_list ap;
+ va_start(ap,fmt);
+ vsnprintf(line,sizeof(line),fmt,ap);
+ va_end(ap);
+
+ appendLog(line);
+}
+
+// ---------------- 로그 이벤트 ----------------
+// 제어 단계는 텍스트를 만들지 않고 이벤트만 logRing 에 넣는다. 로그 단계(logDrain)가 꺼내서
+// 카테고리 마스크를 보고 포맷해 logBuffer/시리얼로 보낸다.
+enum LogEventType{LE_SENSOR,LE_RELAY,LE_WATER_FAIL};
+const char* const RELAY_LOG_NAMES[RID_COUNT]={"HEATER","FAN","LED","PUMP"};
+
+struct LogEvent
+{
+ uint8_t type;
+ uint8_t relay;
+ bool on;
+ centi_t air;
+ permille_t hum;
+ centi_t water;
+};
+
+SpscRing<LogEvent,32> logRing;
+
+void logRelay(int id,bool state)
+{
+ LogEvent e={};
+ e.type=LE_RELAY;
+ e.relay=id;
+ e.on=state;
+ logRing.push(e);
+}
+
+void logDrain()
+{
+ LogEvent e;
+
+ while(logRing.pop(e))
+ {
+  if(e.type==LE_SENSOR)
+  {
+   if(!LOG_ON(LOG_INFO,CAT_SENSOR)) continue;
+
+   char tb[12],hb[12],wb[12];
+
+   fmtFixed(tb,e.air,2,1);
+   fmtFixed(hb,e.hum,1,1);
+   fmtFixed(wb,e.water,2,2);
+
+   logPrintf("[%s] SENSOR",nowStr());
+   logPrintf("[DHT11] Temp=%sC Hum=%s%%",tb,hb);
+   logPrintf("[DS18B20] Water=%sC",wb);
+  }
+  else if(e.type==LE_RELAY)
+  {
+   if(e.relay==RID_PUMP) LOG_I(CAT_PUMP,"[PUMP] %s",e.on?"ON":"OFF");
+   else if(LOG_ON(LOG_INFO,CAT_RELAY)) logPrintf("[%s] [%s] %s",nowStr(),RELAY_LOG_NAMES[e.relay],e.on?"ON":"OFF");
+  }
+  else if(e.type==LE_WATER_FAIL) LOG_E(CAT_SENSOR,"[ERROR] WATER SENSOR FAIL");
+ }
+}
+
+// ---------------- 릴레이 수명 ----------------
+// 릴레이별 누적 사이클(OFF→ON)과 최소 ON/OFF 시간, 정격 사이클 수. 에너지와 같은 주기로 NVS 에 저장한다.
+const uint32_t WEAR_MAGIC=0x57454131; // "WEA1"
+
+// 히터, 팬, LED, 펌프
+const uint16_t WEAR_MIN_ON_SEC[RID_COUNT]={60,30,0,0};
+const uint16_t WEAR_MIN_OFF_SEC[RID_COUNT]={60,30,0,0};
+const uint32_t WEAR_RATED_CYCLES=100000; // 정격 부하 전기적 수명 (SRD-05VDC)
+
+struct WearStore
+{
+ uint32_t magic;
+ uint32_t cycles[RID_COUNT];
+ uint32_t rated[RID_COUNT];
+ uint16_t minOnSec[RID_COUNT];
+ uint16_t minOffSec[RID_COUNT];
+};
+
+WearStore wear;
+
+void wearSave()
+{
+ prefs.putBytes("wear",&wear,sizeof(wear));
+}
+
+void wearLoad()
+{
+ if(prefs.getBytes("wear",&wear,sizeof(wear))==sizeof(wear) && wear.magic==WEAR_MAGIC) return;
+
+ wear.magic=WEAR_MAGIC;
+
+ for(int i=0;i<RID_COUNT;i++)
+ {
+  wear.cycles[i]=0;
+  wear.rated[i]=WEAR_RATED_CYCLES;
+  wear.minOnSec[i]=WEAR_MIN_ON_SEC[i];
+  wear.minOffSec[i]=WEAR_MIN_OFF_SEC[i];
+ }
+}
+
+// ---------------- 에너지 ----------------
+// 릴레이별 ON 시간과 전환 횟수를 시간/일 단위로 모은다. 에너지는 정격전력 x ON 시간.
+// 현재 시간 누적분까지 NVS 에 저장해 재부팅 후에도 이어간다.
+const float RELAY_WATTS[RID_COUNT]={300,5,20,10}; // 히터, 팬, LED, 펌프 (W)
+
+const unsigned long ENERGY_SAVE_INTERVAL=10UL*60UL*1000UL;
+const uint32_t ENERGY_MAGIC=0x454E5231; // "ENR1"
+const int ENERGY_HOURS=24;
+const int ENERGY_DAYS=31;
+
+struct EnergyHour
+{
+ uint32_t hour;                  // unixtime/3600
+ uint16_t onSec[RID_COUNT];
+ uint8_t transitions[RID_COUNT]; // 255 에서 포화
+};
+
+struct EnergyDay
+{
+ uint32_t day;                   // unixtime/86400
+ uint32_t onSec[RID_COUNT];
+ uint16_t transitions[RID_COUNT];
+};
+
+struct EnergyStore
+{
+ uint32_t magic;
+
+ uint32_t curHour;
+ uint32_t curOnMs[RID_COUNT];
+ uint8_t curTransitions[RID_COUNT];
+
+ EnergyDay today;
+
+ EnergyHour hours[ENERGY_HOURS];
+ uint8_t hourHead;
+ uint8_t hourCount;
+
+ EnergyDay days[ENERGY_DAYS];
+ uint8_t dayHead;
+ uint8_t dayCount;
+
+ uint32_t totalOnSec[RID_COUNT];
+ uint32_t totalTransitions[RID_COUNT];
+};
+
+EnergyStore energy;
+
+unsigned long energyLastMs=0;
+unsigned long energyLastSave=0;
+
+bool relayIsOn(int id)
+{
+ switch(id)
+ {
+  case RID_HEATER: return heaterState;
+  case RID_FAN: return fanState;
+  case RID_LED: return ledState;
+  default: return pumpState.load();
+ }
+}
+
+void energyNoteTransition(int id)
+{
+ if(energy.curTransitions[id]<255) energy.curTransitions[id]++;
+ energy.totalTransitions[id]++;
+}
+
+void energySave()
+{
+ prefs.putBytes("energy",&energy,sizeof(energy));
+ wearSave();
+ energyLastSave=millis();
+}
+
+void energyLoad()
+{
+ if(prefs.getBytes("energy",&energy,sizeof(energy))!=sizeof(energy) || energy.magic!=ENERGY_MAGIC)
+ {
+  memset(&energy,0,sizeof(energy));
+  energy.magic=ENERGY_MAGIC;
+ }
+
+ energyLastMs=millis();
+ energyLastSave=energyLastMs;
+}
+
+// 진행 중인 시간을 마감해 시간/일 기록으로 넘긴다.
+void energyCloseHour(uint32_t nextHour)
+{
+ if(energy.curHour)
+ {
+  EnergyHour &h=energy.hours[energy.hourHead];
+
+  h.hour=energy.curHour;
+
+  for(int i=0;i<RID_COUNT;i++)
+  {
+   uint32_t sec=energy.curOnMs[i]/1000;
+   if(sec>3600) sec=3600;
+
+   h.onSec[i]=sec;
+   h.transitions[i]=energy.curTransitions[i];
+
+   energy.totalOnSec[i]+=sec;
+  }
+
+  energy.hourHead=(energy.hourHead+1)%ENERGY_HOURS;
+  if(energy.hourCount<ENERGY_HOURS) energy.hourCount++;
+
+  uint32_t day=energy.curHour/24;
+
+  if(energy.today.day!=day)
+  {
+   if(energy.today.day)
+   {
+    energy.days[energy.dayHead]=energy.today;
+    energy.dayHead=(energy.dayHead+1)%ENERGY_DAYS;
+    if(energy.dayCount<ENERGY_DAYS) energy.dayCount++;
+   }
+
+   memset(&energy.today,0,sizeof(energy.today));
+   energy.today.day=day;
+  }
+
+  for(int i=0;i<RID_COUNT;i++)
+  {
+   energy.today.onSec[i]+=h.onSec[i];
+   energy.today.transitions[i]+=h.transitions[i];
+  }
+ }
+
+ energy.curHour=nextHour;
+ memset(energy.curOnMs,0,sizeof(energy.curOnMs));
+ memset(energy.curTransitions,0,sizeof(energy.curTransitions));
+}
+
+void handleEnergy()
+{
+ unsigned long now=millis();
+ unsigned long dt=now-energyLastMs;
+ energyLastMs=now;
+
+ uint32_t hour=rtcNow.unixtime()/3600;
+
+ if(hour!=energy.curHour)
+ {
+  energyCloseHour(hour);
+  energySave();
+ }
+
+ for(int i=0;i<RID_COUNT;i++)
+ if(relayIsOn(i)) energy.curOnMs[i]+=dt;
+
+ if(now-energyLastSave>=ENERGY_SAVE_INTERVAL) energySave();
+}
+
+float energyWh(int id,uint32_t onSec)
+{
+ return RELAY_WATTS[id]*onSec/3600.0f;
+}
+
+// ---------------- MQTT ----------------
+// 상태(배치)와 릴레이/경보 전환을 MQTT 3.1.1 QoS1 로 보낸다.
+// 모든 메시지는 먼저 오프라인 큐에 들어가고, 연결돼 있을 때 loop 에서 들어온 순서대로 나간다.
+// PUBACK 을 받은 메시지만 큐에서 빠지므로 연결이 끊기면 미확인 메시지부터 다시 보낸다.
+// 큐가 가득 차면 가장 오래된 메시지를 버린다. seq 로 수신측이 유실/순서를 확인할 수 있다.
+// 기본은 꺼져 있다. -DMQTT_ENABLE=1 로 빌드하고 sta_ssid 를 채워야 동작한다.
+// TCP 연결(DNS 포함, 최대 MQTT_CONNECT_TIMEOUT)은 mqttConnectTask 가 맡아 loop 가 멈추지 않는다.
+#ifndef MQTT_ENABLE
+#define MQTT_ENABLE 0
+#endif
+
+#ifndef MQTT_HOST
+#define MQTT_HOST "192.168.0.10"
+#endif
+
+#if MQTT_ENABLE
+
+const uint16_t MQTT_PORT=1883;
+const char* const MQTT_CLIENT_ID="farm-tank1";
+const uint16_t MQTT_KEEPALIVE=60;            // 초
+const int32_t MQTT_CONNECT_TIMEOUT=1000;     // ms
+const unsigned long MQTT_RETRY_MIN=2000;
+const unsigned long MQTT_RETRY_MAX=60000;
+const int MQTT_INFLIGHT=8;                   // PUBACK 없이 보낼 수 있는 최대 메시지
+const int MQTT_MAX_PAYLOAD=512;
+
+enum MqttTopic{MT_STATUS,MT_EVENT,MT_COUNT};
+const char* const MQTT_TOPICS[MT_COUNT]={"farm/tank1/status","farm/tank1/event"};
+
+// 큐 항목: [topic 1B][len 2B][payload]
+const int MQTT_QUEUE_SIZE=8192;
+uint8_t mqttQueue[MQTT_QUEUE_SIZE];
+int mqttHead=0;
+int mqttTail=0;
+int mqttUsed=0;
+
+uint32_t mqttSeq=0;
+unsigned long mqttSent=0;
+unsigned long mqttDropped=0;
+unsigned long mqttConnects=0;
+
+enum MqttState{MS_IDLE,MS_CONNECTING,MS_WAIT_CONNACK,MS_CONNECTED};
+
+// 연결 요청/결과. MC_REQUEST 동안에는 mqttConnectTask 만 mqttClient 를 만진다.
+enum MqttConnect{MC_NONE,MC_REQUEST,MC_OK,MC_FAIL};
+
+WiFiClient mqttClient;
+uint8_t mqttState=MS_IDLE;
+std::atomic<uint8_t> mqttConnectReq(MC_NONE);
+TaskHandle_t mqttTaskHandle=NULL;
+unsigned long mqttLastTry=0;
+unsigned long mqttBackoff=0;
+unsigned long mqttLastTx=0;
+
+// 큐 맨 앞부터 mqttInflight 개가 전송됨(미확인). 패킷 ID 는 맨 앞 메시지가 mqttFrontId, 이후 +1.
+int mqttSendOff=0;
+int mqttInflight=0;
+uint16_t mqttFrontId=1;
+
+// 끊기기 전에 한 번 보낸 구간의 끝. 이 앞의 메시지는 다시 보낼 때 DUP 을 켠다.
+int mqttDupEnd=0;
+
+uint8_t mqttRx[4];
+int mqttRxLen=0;
+
+uint16_t mqttNextId(uint16_t id)
+{
+ return id==0xFFFF?1:id+1;
+}
+
+void mqttRingWrite(const uint8_t* p,int n)
+{
+ for(int i=0;i<n;i++)
+ {
+  mqttQueue[mqttHead]=p[i];
+  mqttHead=(mqttHead+1)%MQTT_QUEUE_SIZE;
+ }
+ mqttUsed+=n;
+}
+
+uint8_t mqttRingAt(int off)
+{
+ return mqttQueue[(mqttTail+off)%MQTT_QUEUE_SIZE];
+}
+
+int mqttLenAt(int off)
+{
+ return mqttRingAt(off+1)|(mqttRingAt(off+2)<<8);
+}
+
+void mqttPop()
+{
+ int n=3+mqttLenAt(0);
+
+ mqttTail=(mqttTail+n)%MQTT_QUEUE_SIZE;
+ mqttUsed-=n;
+ mqttFrontId=mqttNextId(mqttFrontId);
+
+ // 전송 중이던 메시지가 빠지면 창도 같이 줄인다 (늦게 온 PUBACK 은 ID 가 달라 무시된다)
+ if(mqttInflight)
+ {
+  mqttInflight--;
+  mqttSendOff-=n;
+ }
+
+ mqttDupEnd=max(mqttDupEnd-n,0);
+}
+
+// payload 는 JSON 본문(중괄호 안쪽). seq/ts 는 여기서 붙인다.
+void mqttPublishf(int topic,const char* fmt,...)
+{
+ char buf[MQTT_MAX_PAYLOAD];
+
+ int n=snprintf(buf,sizeof(buf),"{\"seq\":%lu,\"ts\":%lu,",
+ (unsigned long)++mqttSeq,(unsigned long)rtcNow.unixtime());
+
+ va_list ap;
+ va_start(ap,fmt);
+ n+=vsnprintf(buf+n,sizeof(buf)-n,fmt,ap);
+ va_end(ap);
+
+ if(n>=(int)sizeof(buf)-1) n=sizeof(buf)-2;
+ buf[n++]='}';
+
+ while(MQTT_QUEUE_SIZE-mqttUsed<3+n)
+ {
+  mqttPop();
+  mqttDropped++;
+ }
+
+ const uint8_t hdr[3]={(uint8_t)topic,(uint8_t)(n&0xFF),(uint8_t)(n>>8)};
+
+ mqttRingWrite(hdr,3);
+ mqttRingWrite((const uint8_t*)buf,n);
+}
+
+// 센서 샘플을 모아 1분마다 한 메시지로 보낸다
+const int MQTT_BATCH=12;
+
+unsigned long getPumpRemainMs();
+
+int16_t mqttBatch[MQTT_BATCH][3];   // 공기 centi, 습도 per-mille, 수온 centi
+int mqttBatchCount=0;
+
+void mqttSample(centi_t t,permille_t h,centi_t w)
+{
+ mqttBatch[mqttBatchCount][0]=t;
+ mqttBatch[mqttBatchCount][1]=h;
+ mqttBatch[mqttBatchCount][2]=waterValid(w)?w:SENSOR_NA;
+
+ if(++mqttBatchCount<MQTT_BATCH) return;
+
+ mqttBatchCount=0;
+
+ static const char* const keys[3]={"air","hum","water"};
+ static const uint8_t scale[3]={2,1,2};
+ static const uint8_t digits[3]={1,1,2};
+ char body[400];
+ int n=0;
+
+ for(int k=0;k<3;k++)
+ {
+  n+=snprintf(body+n,sizeof(body)-n,"%s\"%s\":[",k?",":"",keys[k]);
+
+  for(int i=0;i<MQTT_BATCH && n<(int)sizeof(body)-16;i++)
+  {
+   if(i) body[n++]=',';
+   int16_t v=mqttBatch[i][k];
+   if(v==SENSOR_NA) n+=snprintf(body+n,sizeof(body)-n,"null");
+   else n+=fmtFixed(body+n,v,scale[k],digits[k]);
+  }
+
+  if(n<(int)sizeof(body)) n+=snprintf(body+n,sizeof(body)-n,"]");
+ }
+
+ mqttPublishf(MT_STATUS,"\"dt\":5,%s,\"heater\":%d,\"fan\":%d,\"led\":%d,\"pump\":%d,\"pump_rem\":%lu",
+ body,heaterState,fanState,ledState,pumpState.load(),getPumpRemainMs()/1000);
+}
+
+bool mqttWrite(const uint8_t* p,int n)
+{
+ if(mqttClient.write(p,n)!=(size_t)n) return false;
+ mqttLastTx=millis();
+ return true;
+}
+
+// 남은 길이 가변 인코딩
+int mqttRemaining(uint8_t* p,int len)
+{
+ int n=0;
+ do
+ {
+  uint8_t b=len%128;
+  len/=128;
+  if(len) b|=0x80;
+  p[n++]=b;
+ }
+ while(len);
+ return n;
+}
+
+bool mqttSendConnect()
+{
+ uint8_t pkt[64];
+ int idLen=strlen(MQTT_CLIENT_ID);
+ int n=0;
+
+ pkt[n++]=0x10;
+ n+=mqttRemaining(pkt+n,10+2+idLen);
+
+ const uint8_t var[10]={0,4,'M','Q','T','T',4,0x02,MQTT_KEEPALIVE>>8,MQTT_KEEPALIVE&0xFF};
+ memcpy(pkt+n,var,10);
+ n+=10;
+
+ pkt[n++]=idLen>>8;
+ pkt[n++]=idLen&0xFF;
+ memcpy(pkt+n,MQTT_CLIENT_ID,idLen);
+ n+=idLen;
+
+ return mqttWrite(pkt,n);
+}
+
+// 큐의 off 위치 메시지를 PUBLISH 한 패킷으로 모아 한 번에 쓴다.
+// (헤더와 payload 를 따로 쓰면 Nagle 과 지연 ACK 때문에 패킷마다 수십 ms 씩 묶인다)
+// dup: 이전 연결에서 이미 보낸 메시지 (MQTT 3.1.1 3.3.1.1)
+bool mqttSendAt(int off,uint16_t id,bool dup)
+{
+ const char* topic=MQTT_TOPICS[mqttRingAt(off)];
+ int topicLen=strlen(topic);
+ int len=mqttLenAt(off);
+
+ uint8_t pkt[64+MQTT_MAX_PAYLOAD];
+ int n=0;
+
+ pkt[n++]=dup?0x3A:0x32;
+ n+=mqttRemaining(pkt+n,2+topicLen+2+len);
+ pkt[n++]=topicLen>>8;
+ pkt[n++]=topicLen&0xFF;
+ memcpy(pkt+n,topic,topicLen);
+ n+=topicLen;
+ pkt[n++]=id>>8;
+ pkt[n++]=id&0xFF;
+
+ int start=(mqttTail+off+3)%MQTT_QUEUE_SIZE;
+ int first=min(len,MQTT_QUEUE_SIZE-start);
+
+ memcpy(pkt+n,mqttQueue+start,first);
+ memcpy(pkt+n+first,mqttQueue,len-first);
+
+ return mqttWrite(pkt,n+len);
+}
+
+void mqttDisconnected(const char* why)
+{
+ mqttClient.stop();
+
+ if(mqttState==MS_CONNECTED) LOG_W(CAT_SYSTEM,"[MQTT] disconnected (%s), queued=%d",why,mqttUsed);
+
+ mqttState=MS_IDLE;
+ mqttDupEnd=max(mqttDupEnd,mqttSendOff);
+ mqttSendOff=0;
+ mqttInflight=0;
+ mqttRxLen=0;
+ mqttLastTry=millis();
+ mqttBackoff=mqttBackoff?min(mqttBackoff*2,MQTT_RETRY_MAX):MQTT_RETRY_MIN;
+}
+
+// 블로킹 connect 만 대신 한다. 결과를 넘긴 뒤에는 mqttClient 를 loop 가 쓴다.
+void mqttConnectTask(void*)
+{
+ for(;;)
+ {
+  if(mqttConnectReq.load(std::memory_order_acquire)!=MC_REQUEST)
+  {
+   vTaskDelay(pdMS_TO_TICKS(20));
+   continue;
+  }
+
+  bool ok=mqttClient.connect(MQTT_HOST,MQTT_PORT,MQTT_CONNECT_TIMEOUT);
+  mqttConnectReq.store(ok?MC_OK:MC_FAIL,std::memory_order_release);
+ }
+}
+
+void handleMqtt()
+{
+ // 연결 중에는 결과가 올 때까지 mqttClient 를 건드리지 않는다
+ if(mqttState==MS_CONNECTING)
+ {
+  uint8_t r=mqttConnectReq.load(std::memory_order_acquire);
+  if(r==MC_REQUEST) return;
+
+  mqttConnectReq.store(MC_NONE,std::memory_order_relaxed);
+
+  if(r!=MC_OK || !mqttSendConnect())
+  {
+   mqttDisconnected("connect");
+   return;
+  }
+
+  mqttState=MS_WAIT_CONNACK;
+  return;
+ }
+
+ if(WiFi.status()!=WL_CONNECTED)
+ {
+  if(mqttState!=MS_IDLE) mqttDisconnected("wifi");
+  return;
+ }
+
+ if(mqttState==MS_IDLE)
+ {
+  if(mqttLastTry && millis()-mqttLastTry<mqttBackoff) return;
+
+  if(!mqttTaskHandle)
+  xTaskCreatePinnedToCore(mqttConnectTask,"mqttConnect",4096,NULL,tskIDLE_PRIORITY+1,&mqttTaskHandle,0);
+
+  mqttLastTry=millis();
+  mqttState=MS_CONNECTING;
+  mqttConnectReq.store(MC_REQUEST,std::memory_order_release);
+  return;
+ }
+
+ if(!mqttClient.connected())
+ {
+  mqttDisconnected("closed");
+  return;
+ }
+
+ if(mqttState==MS_WAIT_CONNACK)
+ {
+  if(mqttClient.available()<4)
+  {
+   if(millis()-mqttLastTry>5000) mqttDisconnected("connack timeout");
+   return;
+  }
+
+  uint8_t ack[4];
+  mqttClient.read(ack,4);
+
+  if(ack[0]!=0x20 || ack[3]!=0)
+  {
+   LOG_W(CAT_SYSTEM,"[MQTT] refused rc=%u",ack[3]);
+   mqttDisconnected("refused");
+   return;
+  }
+
+  mqttState=MS_CONNECTED;
+  mqttBackoff=0;
+  mqttConnects++;
+
+  LOG_I(CAT_SYSTEM,"[MQTT] connected %s, replaying %d bytes",MQTT_HOST,mqttUsed);
+ }
+
+ // 수신은 PUBACK(4B)/PINGRESP(2B) 뿐이다. 맨 앞 메시지의 PUBACK 이면 큐에서 뺀다.
+ while(mqttClient.available()>0)
+ {
+  int c=mqttClient.read();
+  if(c<0) break;
+
+  mqttRx[mqttRxLen++]=c;
+
+  int need=(mqttRx[0]==0x40)?4:2;
+  if(mqttRxLen<need) continue;
+
+  mqttRxLen=0;
+
+  if(mqttRx[0]!=0x40 || !mqttInflight) continue;
+
+  uint16_t id=(mqttRx[2]<<8)|mqttRx[3];
+  if(id!=mqttFrontId) continue;
+
+  mqttPop();
+  mqttSent++;
+ }
+
+ // 창이 허락하는 만큼 순서대로 보낸다
+ while(mqttInflight<MQTT_INFLIGHT && mqttSendOff<mqttUsed)
+ {
+  uint16_t id=mqttFrontId;
+  for(int i=0;i<mqttInflight;i++) id=mqttNextId(id);
+
+  if(!mqttSendAt(mqttSendOff,id,mqttSendOff<mqttDupEnd))
+  {
+   mqttDisconnected("write");
+   return;
+  }
+
+  mqttSendOff+=3+mqttLenAt(mqttSendOff);
+  mqttInflight++;
+ }
+
+ if(millis()-mqttLastTx>=MQTT_KEEPALIVE*500UL)
+ {
+  const uint8_t ping[2]={0xC0,0};
+  if(!mqttWrite(ping,2)) mqttDisconnected("ping");
+ }
+}
+
+#else
+
+enum MqttTopic{MT_STATUS,MT_EVENT,MT_COUNT};
+
+void mqttPublishf(int,const char*,...){}
+void mqttSample(centi_t,permille_t,centi_t){}
+void handleMqtt(){}
+
+#endif
+
+// ---------------- 트레이스 ----------------
+// 센서값과 릴레이 명령을 시간순으로 기록해 호스트에서 재생(tools/trace_replay.cpp)한다.
+// 센서값은 lastAirTemp 등과 같은 고정소수점 그대로, 읽기 실패는 SENSOR_NA.
+const int TRACE_CAPACITY=1024;
+
+struct TraceRecord
+{
+ uint32_t ms;
+ char type;   // 'S' 센서, 'R' 릴레이
+ uint8_t id;  // 'R' 일 때 RelayId
+ int16_t a;   // S: 공기온도(centi), R: 상태
+ int16_t b;   // S: 습도(per-mille)
+ int16_t c;   // S: 수온(centi)
+};
+
+TraceRecord traceBuf[TRACE_CAPACITY];
+int traceHead=0;
+int traceCount=0;
+
+TraceRecord &traceNext(char type)
+{
+ TraceRecord &r=traceBuf[traceHead];
+
+ traceHead=(traceHead+1)%TRACE_CAPACITY;
+ if(traceCount<TRACE_CAPACITY) traceCount++;
+
+ r.ms=millis();
+ r.type=type;
+ r.id=0;
+ r.a=r.b=r.c=0;
+
+ return r;
+}
+
+void traceSensor(centi_t t,permille_t h,centi_t w)
+{
+ TraceRecord &r=traceNext('S');
+ r.a=t;
+ r.b=h;
+ r.c=w;
+}
+
+// ---------------- 릴레이 이력 ----------------
+// 전환마다 3바이트 이벤트(직전 이벤트/체크포인트로부터의 초, 릴레이, 새 상태, 원인)를 남긴다.
+// 이벤트 32개 또는 1시간마다 전체 상태를 체크포인트로 찍어 두고, 과거 시점의 상태는
+// 그 시점 직전 체크포인트를 이분 탐색으로 찾아 앞으로 최대 32개만 재생해서 구한다.
+enum RelayCause{RC_BOOT,RC_SCHEDULE,RC_TIMER,RC_HYSTERESIS,RC_FAILSAFE,RC_COUNT};
+const char* const RELAY_CAUSE_NAMES[RC_COUNT]={"boot","schedule","timer","hysteresis","failsafe"};
+
+const int RELAY_HISTORY_EVENTS=2048;       // 펌프 7초/53초 주기 기준 약 17시간
+const int RELAY_HISTORY_CHECKPOINTS=128;
+const uint32_t RELAY_CHECKPOINT_EVENTS=32;
+const uint32_t RELAY_CHECKPOINT_SEC=3600;  // dt 가 uint16 을 넘지 않게 한다
+
+struct __attribute__((packed)) RelayEvent
+{
+ uint16_t dt;      // 초
+ uint8_t bits;     // id | on<<2 | cause<<3
+};
+
+struct RelayCheckpoint
+{
+ uint32_t epoch;
+ uint32_t seq;                // 이 체크포인트 다음 첫 이벤트 번호
+ uint32_t since[RID_COUNT];   // 릴레이별 마지막 전환 시각
+ uint8_t states;              // RID 비트
+ uint8_t causes[RID_COUNT];
+};
+
+RelayEvent relayEvents[RELAY_HISTORY_EVENTS];
+RelayCheckpoint relayCheckpoints[RELAY_HISTORY_CHECKPOINTS];
+uint32_t relayEventCount=0;
+uint32_t relayCheckpointCount=0;
+uint32_t relayHistEpoch=0;     // 마지막 이벤트/체크포인트 시각
+RelayCheckpoint relayHistNow;  // 현재 상태, 다음 체크포인트의 원본
+
+void relayCheckpoint(uint32_t epoch)
+{
+ relayHistNow.epoch=epoch;
+ relayHistNow.seq=relayEventCount;
+ relayCheckpoints[relayCheckpointCount++%RELAY_HISTORY_CHECKPOINTS]=relayHistNow;
+ relayHistEpoch=epoch;
+}
+
+// 부팅 시 전부 OFF 상태로 시작
+void relayHistoryBegin()
+{
+ uint32_t now=rtcNow.unixtime();
+
+ for(int i=0;i<RID_COUNT;i++)
+ {
+  relayHistNow.since[i]=now;
+  relayHistNow.causes[i]=RC_BOOT;
+ }
+
+ relayHistNow.states=0;
+ relayCheckpoint(now);
+}
+
+void relayHistoryRecord(int id,bool on,uint8_t cause)
+{
+ uint32_t now=rtcNow.unixtime();
+
+ if(now<relayHistEpoch) now=relayHistEpoch;   // RTC 가 뒤로 가도 시각은 단조 증가
+ if(now-relayHistEpoch>=RELAY_CHECKPOINT_SEC) relayCheckpoint(now);
+
+ RelayEvent &e=relayEvents[relayEventCount++%RELAY_HISTORY_EVENTS];
+ e.dt=now-relayHistEpoch;
+ e.bits=id|(on?4:0)|(cause<<3);
+ relayHistEpoch=now;
+
+ if(on) relayHistNow.states|=1<<id;
+ else relayHistNow.states&=~(1<<id);
+ relayHistNow.since[id]=now;
+ relayHistNow.causes[id]=cause;
+
+ const RelayCheckpoint &last=relayCheckpoints[(relayCheckpointCount-1)%RELAY_HISTORY_CHECKPOINTS];
+ if(relayEventCount-last.seq>=RELAY_CHECKPOINT_EVENTS) relayCheckpoint(now);
+}
+
+// 전환이 없어도 한 시간마다 체크포인트
+void handleRelayHistory()
+{
+ uint32_t now=rtcNow.unixtime();
+
+ if(now>relayHistEpoch && now-relayHistEpoch>=RELAY_CHECKPOINT_SEC) relayCheckpoint(now);
+}
+
+// 이벤트가 아직 링에 남아 있는 가장 오래된 체크포인트 번호
+uint32_t relayOldestCheckpoint()
+{
+ uint32_t lo=relayCheckpointCount>RELAY_HISTORY_CHECKPOINTS?relayCheckpointCount-RELAY_HISTORY_CHECKPOINTS:0;
+ uint32_t evLo=relayEventCount>RELAY_HISTORY_EVENTS?relayEventCount-RELAY_HISTORY_EVENTS:0;
+
+ while(lo<relayCheckpointCount && relayCheckpoints[lo%RELAY_HISTORY_CHECKPOINTS].seq<evLo) lo++;
+
+ return lo;
+}
+
+// epoch 이하인 마지막 체크포인트 번호, 없으면 -1
+long relayFindCheckpoint(uint32_t epoch)
+{
+ uint32_t lo=relayOldestCheckpoint(),hi=relayCheckpointCount;
+
+ if(lo>=hi || relayCheckpoints[lo%RELAY_HISTORY_CHECKPOINTS].epoch>epoch) return -1;
+
+ while(hi-lo>1)
+ {
+  uint32_t mid=lo+(hi-lo)/2;
+  if(relayCheckpoints[mid%RELAY_HISTORY_CHECKPOINTS].epoch<=epoch) lo=mid;
+  else hi=mid;
+ }
+
+ return lo;
+}
+
+// 체크포인트 k 부터 다음 체크포인트 전까지의 이벤트를 재생한다.
+// 시각이 until 을 넘는 이벤트에서 멈추고, 재생한 개수를 돌려준다.
+int relayReplay(uint32_t k,uint32_t until,RelayCheckpoint &st,void (*onEvent)(uint32_t,const RelayEvent&)=NULL)
+{
+ st=relayCheckpoints[k%RELAY_HISTORY_CHECKPOINTS];
+
+ uint32_t end=(k+1<relayCheckpointCount)?relayCheckpoints[(k+1)%RELAY_HISTORY_CHECKPOINTS].seq:relayEventCount;
+ uint32_t t=st.epoch;
+ int n=0;
+
+ for(uint32_t q=st.seq;q<end;q++)
+ {
+  const RelayEvent &e=relayEvents[q%RELAY_HISTORY_EVENTS];
+  int id=e.bits&3;
+
+  t+=e.dt;
+  if(t>until) break;
+
+  if(e.bits&4) st.states|=1<<id;
+  else st.states&=~(1<<id);
+  st.since[id]=t;
+  st.causes[id]=e.bits>>3;
+  n++;
+
+  if(onEvent) onEvent(t,e);
+ }
+
+ st.epoch=t;
+ return n;
+}
+
+void noteRelay(int id,bool on,uint8_t cause)
+{
+ relayTransitions[id]++;
+ energyNoteTransition(id);
+ relayHistoryRecord(id,on,cause);
+
+ TraceRecord &r=traceNext('R');
+ r.id=id;
+ r.a=on?1:0;
+
+ mqttPublishf(MT_EVENT,"\"relay\":\"%s\",\"on\":%d,\"cause\":\"%s\"",RELAY_NAMES[id],on,RELAY_CAUSE_NAMES[cause]);
+}
+
+// ---------------- 릴레이 계층 ----------------
+// 히터/팬/LED 는 relaySet 으로만 바꾼다. 최소 ON/OFF 시간은 여기서 지키고(안전 OFF 는 예외),
+// 전환 기록/로그/수명 카운터도 relayCommit 한 곳에서 남긴다.
+// 펌프는 타이머 콜백이 GPIO 를 직접 쓰므로 구간 길이에 최소 시간을 반영하고 기록만 relayCommit 으로 한다.
+unsigned long relayChangedMs[RID_COUNT]={0}; // 부팅 시각도 전환으로 본다 (재부팅이 반복될 때 보호)
+unsigned long relayHeld[RID_COUNT]={0}; // 최소 시간 때문에 미룬 명령 수
+bool relayHeldPending[RID_COUNT]={false}; // 미룬 명령이 아직 걸려 있음 (같은 명령의 재시도는 세지 않는다)
+
+void relayCommit(int id,bool on,uint8_t cause)
+{
+ relayChangedMs[id]=millis();
+ if(on) wear.cycles[id]++;
+
+ noteRelay(id,on,cause);
+ logRelay(id,on);
+}
+
+// 바뀌었으면 true. 최소 시간에 걸려 미루면 false (다음 판단 때 다시 요청된다).
+bool relaySet(int id,bool on,uint8_t cause)
+{
+ // 지금 상태와 같은 명령이면 걸려 있던 반대 명령은 철회된 것이다
+ if(relayIsOn(id)==on)
+ {
+  relayHeldPending[id]=false;
+  return false;
+ }
+
+ unsigned long minMs=(on?wear.minOffSec[id]:wear.minOnSec[id])*1000UL;
+
+ if(cause!=RC_FAILSAFE && millis()-relayChangedMs[id]<minMs)
+ {
+  if(!relayHeldPending[id]) relayHeld[id]++;
+  relayHeldPending[id]=true;
+  return false;
+ }
+
+ relayHeldPending[id]=false;
+
+ switch(id)
+ {
+  case RID_HEATER: heaterState=on; relayBank.stage<HeaterRelay>(on); break;
+  case RID_FAN: fanState=on; relayBank.stage<FanRelay>(on); break;
+  case RID_LED: ledState=on; relayBank.stage<LedRelay>(on); break;
+  default: return false;
+ }
+
+ relayCommit(id,on,cause);
+ return true;
+}
+
+// 하루 사이클 수: 마감된 시간 기록(최대 24시간) 기준, 없으면 0
+float wearCyclesPerDay(int id)
+{
+ if(!energy.hourCount) return 0;
+
+ uint32_t transitions=0;
+ for(int i=0;i<energy.hourCount;i++) transitions+=energy.hours[i].transitions[id];
+
+ return transitions/2.0f*24.0f/energy.hourCount;
+}
+
+// ---------------- 펌프 ----------------
+unsigned long getPumpRemainMs()
+{
+ portENTER_CRITICAL(&pumpMux);
+ int64_t deadline=pumpDeadlineUs;
+ portEXIT_CRITICAL(&pumpMux);
+
+ int64_t remain=deadline-esp_timer_get_time();
+
+ if(remain<=0) return 0;
+
+ return (unsigned long)(remain/1000);
+}
+
+void pumpTimerCb(void*)
+{
+ bool on=!pumpState.load();
+
+ // 뱅크를 거치지 않고 바로 쓴다 (W1TS/W1TC 는 원자적이라 loop 의 flush 와 겹쳐도 안전)
+ if(PumpRelay::level(on))
+ {
+  if(PumpRelay::bank) REG_WRITE(GPIO_OUT1_W1TS_REG,PumpRelay::mask);
+  else REG_WRITE(GPIO_OUT_W1TS_REG,PumpRelay::mask);
+ }
+ else
+ {
+  if(PumpRelay::bank) REG_WRITE(GPIO_OUT1_W1TC_REG,PumpRelay::mask);
+  else REG_WRITE(GPIO_OUT_W1TC_REG,PumpRelay::mask);
+ }
+
+ pumpState=on;
+ pumpEdges++;
+
+ int64_t now=esp_timer_get_time();
+ int64_t next;
+
+ unsigned long len=on?PUMP_ON_TIME:PUMP_OFF_TIME;
+ unsigned long minMs=(on?wear.minOnSec[RID_PUMP]:wear.minOffSec[RID_PUMP])*1000UL;
+ if(len<minMs) len=minMs;
+
+ portENTER_CRITICAL(&pumpMux);
+ pumpDeadlineUs+=(int64_t)len*1000LL;
+ if(pumpDeadlineUs<now) pumpDeadlineUs=now; // 콜백이 한 구간 이상 밀린 경우
+ next=pumpDeadlineUs;
+ portEXIT_CRITICAL(&pumpMux);
+
+ esp_timer_start_once(pumpTimerHandle,next-now);
+}
+
+void startPumpTimer()
+{
+ esp_timer_create_args_t args={};
+ args.callback=pumpTimerCb;
+ args.name="pump";
+
+ esp_timer_create(&args,&pumpTimerHandle);
+
+ pumpDeadlineUs=esp_timer_get_time()+(int64_t)PUMP_OFF_TIME*1000LL;
+ esp_timer_start_once(pumpTimerHandle,(uint64_t)PUMP_OFF_TIME*1000ULL);
+}
+
+// 타이머가 만든 경계를 loop 에서 기록한다.
+void handlePump()
+{
+ uint32_t edges=pumpEdges.load();
+
+ while(pumpEdgesSeen!=edges)
+ {
+  pumpEdgesSeen++;
+
+  bool on=pumpEdgesSeen&1;
+
+  relayCommit(RID_PUMP,on,RC_TIMER);
+ }
+}
+
+// ---------------- LED ----------------
+void handleLED()
+{
+ int cur=rtcNow.hour()*60+rtcNow.minute();
+
+ int on=5*60+30;
+ int off=22*60+30;
+
+ relaySet(RID_LED,cur>=on && cur<off,RC_SCHEDULE);
+}
+
+// ---------------- 수온 ----------------
+void handleWaterControl(centi_t w)
+{
+ bool newHeater=heaterState;
+ bool newFan=fanState;
+
+ if(!heaterState && w<=HEATER_ON)
+ {
+  newHeater=true;
+  newFan=false;
+ }
+ else if(heaterState && w>=heaterOffAt)
+ newHeater=false;
+
+ if(!fanState && w>=FAN_ON)
+ {
+  newFan=true;
+  newHeater=false;
+ }
+ else if(fanState && w<=fanOffAt)
+ newFan=false;
+
+ // 끄는 쪽을 먼저. 상대가 최소 ON 시간에 묶여 아직 켜져 있으면 켜지 않는다.
+ if(!newHeater) relaySet(RID_HEATER,false,RC_HYSTERESIS);
+ if(!newFan) relaySet(RID_FAN,false,RC_HYSTERESIS);
+
+ if(newHeater && !fanState) relaySet(RID_HEATER,true,RC_HYSTERESIS);
+ if(newFan && !heaterState) relaySet(RID_FAN,true,RC_HYSTERESIS);
+}
+
+// ---------------- 히스테리시스 자동 조정 ----------------
+// 한 시간 창마다 히터/팬의 시간당 사이클 수와 수온 최저/최고를 보고 OFF 경계를 0.1도씩 옮긴다.
+// 창 하나의 사이클 수는 몇 안 되는 정수이고 실온의 하루 주기를 따라 오르내리므로, 최근 24개 창의
+// 이동 평균으로 판단한다. 경계를 옮긴 뒤에는 새 경계로 24개 창이 다시 쌓여야 그 릴레이를 옮긴다.
+// 평균이 목표의 1.25배보다 크면 불감대를 넓히고, 목표의 절반도 안 되면 좁힌다.
+// 히터 오버슈트가 팬 OFF 경계까지(팬은 반대로 히터 OFF 경계까지) 가면 넓히지 않고 좁힌다.
+// ON 경계(22.0/26.0)는 건드리지 않으므로 보호 동작은 그대로다. 바뀐 값은 NVS 에 저장한다.
+const uint32_t TUNE_MAGIC=0x54554E31; // "TUN1"
+const uint32_t TUNE_WINDOW_SEC=3600;
+const uint8_t TUNE_TARGET_CPH=4;
+
+const centi_t TUNE_STEP=10;
+const centi_t TUNE_WIDTH_MIN=20;  // 불감대 0.2도
+const centi_t TUNE_WIDTH_MAX=200; // 불감대 2.0도
+const centi_t TUNE_GAP_MIN=50;    // 히터 OFF ~ 팬 OFF 최소 간격
+const int TUNE_AVG_WINDOWS=24;    // 하루
+
+struct TuneStore
+{
+ uint32_t magic;
+ uint8_t enabled;
+ uint8_t targetCph;
+ uint16_t adjustments;
+ centi_t heaterOff;
+ centi_t fanOff;
+};
+
+TuneStore tune;
+
+// 진행 중인 창
+uint32_t tuneWindowStart=0;
+unsigned long tuneStartTransitions[2]; // RID_HEATER, RID_FAN
+centi_t tuneMin=INT16_MAX;
+centi_t tuneMax=INT16_MIN;
+
+// 직전 창
+uint32_t tuneLastSec=0;
+uint16_t tuneLastCycles[2]={0,0};
+centi_t tuneLastMin=SENSOR_NA;
+centi_t tuneLastMax=SENSOR_NA;
+
+// 최근 창들의 사이클 수. 합/개수가 시간당 평균이다
+uint16_t tuneAvgRing[2][TUNE_AVG_WINDOWS];
+uint32_t tuneAvgSum[2]={0,0};
+uint8_t tuneAvgHead=0;
+uint8_t tuneAvgWindows[2]={0,0}; // 현재 경계로 쌓인 창 (최대 TUNE_AVG_WINDOWS)
+
+void tuneDefaults()
+{
+ memset(&tune,0,sizeof(tune));
+ tune.magic=TUNE_MAGIC;
+ tune.targetCph=TUNE_TARGET_CPH;
+ tune.heaterOff=HEATER_OFF;
+ tune.fanOff=FAN_OFF;
+}
+
+// 저장값이 범위를 벗어나 있으면 기본 경계로 돌린다
+void tuneApply()
+{
+ if(tune.heaterOff<HEATER_ON+TUNE_WIDTH_MIN || tune.heaterOff>HEATER_ON+TUNE_WIDTH_MAX ||
+ tune.fanOff>FAN_ON-TUNE_WIDTH_MIN || tune.fanOff<FAN_ON-TUNE_WIDTH_MAX ||
+ tune.fanOff-tune.heaterOff<TUNE_GAP_MIN)
+ {
+  tune.heaterOff=HEATER_OFF;
+  tune.fanOff=FAN_OFF;
+ }
+
+ heaterOffAt=tune.heaterOff;
+ fanOffAt=tune.fanOff;
+}
+
+void tuneSave()
+{
+ prefs.putBytes("tune",&tune,sizeof(tune));
+}
+
+void tuneLoad()
+{
+ if(prefs.getBytes("tune",&tune,sizeof(tune))!=sizeof(tune) || tune.magic!=TUNE_MAGIC) tuneDefaults();
+
+ tuneApply();
+}
+
+void tuneWindowReset(uint32_t epoch)
+{
+ tuneWindowStart=epoch;
+ tuneStartTransitions[RID_HEATER]=relayTransitions[RID_HEATER];
+ tuneStartTransitions[RID_FAN]=relayTransitions[RID_FAN];
+ tuneMin=INT16_MAX;
+ tuneMax=INT16_MIN;
+}
+
+void tuneAverageReset(int id)
+{
+ tuneAvgWindows[id]=0;
+ tuneAvgSum[id]=0;
+}
+
+// 창 하나를 넣는다. 가득 차면 가장 오래된 창이 빠진다
+void tuneAverage(uint16_t heaterCycles,uint16_t fanCycles)
+{
+ const uint16_t c[2]={heaterCycles,fanCycles};
+
+ for(int id=0;id<2;id++)
+ {
+  if(tuneAvgWindows[id]==TUNE_AVG_WINDOWS) tuneAvgSum[id]-=tuneAvgRing[id][tuneAvgHead];
+  else tuneAvgWindows[id]++;
+
+  tuneAvgRing[id][tuneAvgHead]=c[id];
+  tuneAvgSum[id]+=c[id];
+ }
+
+ tuneAvgHead=(tuneAvgHead+1)%TUNE_AVG_WINDOWS;
+}
+
+// 시간당 평균 사이클 (x100)
+int32_t tuneAvgCph(int id)
+{
+ return tuneAvgWindows[id]?(int32_t)(tuneAvgSum[id]*100/tuneAvgWindows[id]):0;
+}
+
+// 평균과 직전 창으로 한 단계 조정한다. 경계가 바뀌면 true.
+// 반대쪽 OFF 경계까지 간 오버슈트는 평균을 기다리지 않고 바로 좁힌다.
+bool tuneStep()
+{
+ int32_t target=(int32_t)tune.targetCph*100;
+ int32_t ha=tuneAvgCph(RID_HEATER);
+ int32_t fa=tuneAvgCph(RID_FAN);
+ bool hReady=tuneAvgWindows[RID_HEATER]>=TUNE_AVG_WINDOWS;
+ bool fReady=tuneAvgWindows[RID_FAN]>=TUNE_AVG_WINDOWS;
+
+ int h=tune.heaterOff;
+ int f=tune.fanOff;
+
+ if(tuneLastCycles[RID_HEATER] && tuneLastMax>=fanOffAt) h-=TUNE_STEP;
+ else if(hReady && ha*4>target*5 && tuneLastMax+TUNE_STEP<fanOffAt) h+=TUNE_STEP;
+ else if(hReady && tuneLastCycles[RID_HEATER] && ha*2<target) h-=TUNE_STEP;
+
+ if(tuneLastCycles[RID_FAN] && tuneLastMin<=heaterOffAt) f+=TUNE_STEP;
+ else if(fReady && fa*4>target*5 && tuneLastMin-TUNE_STEP>heaterOffAt) f-=TUNE_STEP;
+ else if(fReady && tuneLastCycles[RID_FAN] && fa*2<target) f+=TUNE_STEP;
+
+ h=constrain(h,HEATER_ON+TUNE_WIDTH_MIN,HEATER_ON+TUNE_WIDTH_MAX);
+ f=constrain(f,FAN_ON-TUNE_WIDTH_MAX,FAN_ON-TUNE_WIDTH_MIN);
+
+ if(f-h<TUNE_GAP_MIN) return false;
+ if(h==tune.heaterOff && f==tune.fanOff) return false;
+
+ // 새 경계로 다시 평균을 쌓는다
+ if(h!=tune.heaterOff) tuneAverageReset(RID_HEATER);
+ if(f!=tune.fanOff) tuneAverageReset(RID_FAN);
+
+ tune.heaterOff=h;
+ tune.fanOff=f;
+ return true;
+}
+
+// 유효한 수온 샘플마다 부른다. 창은 조정이 꺼져 있어도 돌아 API 로 사이클 수를 볼 수 있다.
+void tuneSample(centi_t w,uint32_t epoch)
+{
+ if(!tuneWindowStart || epoch<tuneWindowStart) tuneWindowReset(epoch);
+
+ if(w<tuneMin) tuneMin=w;
+ if(w>tuneMax) tuneMax=w;
+
+ uint32_t sec=epoch-tuneWindowStart;
+ if(sec<TUNE_WINDOW_SEC) return;
+
+ tuneLastSec=sec;
+ tuneLastCycles[RID_HEATER]=(relayTransitions[RID_HEATER]-tuneStartTransitions[RID_HEATER])/2;
+ tuneLastCycles[RID_FAN]=(relayTransitions[RID_FAN]-tuneStartTransitions[RID_FAN])/2;
+ tuneLastMin=tuneMin;
+ tuneLastMax=tuneMax;
+
+ tuneAverage(tuneLastCycles[RID_HEATER],tuneLastCycles[RID_FAN]);
+
+ tuneWindowReset(epoch);
+
+ if(!tune.enabled || !tuneStep()) return;
+
+ tune.adjustments++;
+ tuneApply();
+ tuneSave();
+
+ char hb[12],fb[12],ha[12],fa[12];
+ fmtFixed(hb,tune.heaterOff,2,2);
+ fmtFixed(fb,tune.fanOff,2,2);
+ fmtFixed(ha,tuneAvgCph(RID_HEATER),2,2);
+ fmtFixed(fa,tuneAvgCph(RID_FAN),2,2);
+
+ LOG_I(CAT_SYSTEM,"[TUNE] heater off=%s fan off=%s (avg cycles/h heater=%s fan=%s)",hb,fb,ha,fa);
+}
+
+// ---------------- 경보 ----------------
+// 샘플마다 규칙당 O(1) 로 평가한다. 조건이 hold 샘플 연속이면 발생, 연속 hold 샘플 거짓이면 해제.
+// latch 규칙은 조건이 사라져도 /api/alarms/ack 전까지 유지된다.
+enum AlarmKind{AK_HIGH,AK_LOW,AK_RATE,AK_STALE,AK_STUCK_HEATER};
+enum AlarmInput{AI_WATER,AI_AIR,AI_HUM};
+
+struct AlarmRule
+{
+ const char* name;
+ uint8_t kind;
+ uint8_t input;
+ int16_t threshold; // 입력 단위(centi/per-mille). HIGH/LOW: 값, RATE: 분당 변화량, STALE: 초, STUCK_HEATER: 최소 상승
+ int16_t clear;     // HIGH/LOW 해제값 (히스테리시스)
+ uint8_t hold;    // 디바운스 샘플 수
+ uint32_t window; // STUCK_HEATER: 히터 ON 지속 시간(초)
+ bool latch;
+};
+
+const AlarmRule ALARM_RULES[]=
+{
+ {"WATER_HIGH",AK_HIGH,AI_WATER,2800,2750,3,0,false},
+ {"WATER_LOW",AK_LOW,AI_WATER,2000,2050,3,0,false},
+ {"WATER_RATE",AK_RATE,AI_WATER,100,0,2,0,false},
+ {"WATER_STALE",AK_STALE,AI_WATER,60,0,1,0,true},
+ {"AIR_HIGH",AK_HIGH,AI_AIR,3500,3400,3,0,false},
+ {"AIR_LOW",AK_LOW,AI_AIR,500,600,3,0,false},
+ {"AIR_STALE",AK_STALE,AI_AIR,60,0,1,0,false},
+ {"HUM_HIGH",AK_HIGH,AI_HUM,900,850,3,0,false},
+ {"HUM_LOW",AK_LOW,AI_HUM,200,250,3,0,false},
+ {"HEATER_STUCK",AK_STUCK_HEATER,AI_WATER,20,0,1,3UL*3600UL,true},
+};
+
+const int ALARM_COUNT=sizeof(ALARM_RULES)/sizeof(ALARM_RULES[0]);
+
+struct AlarmState
+{
+ uint8_t count;  // 디바운스 카운터
+ bool active;
+ bool latched;
+ int32_t value;  // 마지막 평가값 (규칙 단위)
+};
+
+AlarmState alarmStates[ALARM_COUNT];
+
+// 입력별 최근 유효 샘플 (RATE/STALE/STUCK 용)
+const uint8_t ALARM_INPUT_SCALE[3]={2,2,1};   // 수온, 공기, 습도
+
+unsigned long alarmValidMs[3]={0,0,0};
+
+// RATE 기준값: RATE_SLOT_MS 마다 찍어 둔 유효 샘플 RATE_SLOTS 개. 가장 오래된 칸은 최소
+// (RATE_SLOTS-1)*RATE_SLOT_MS, 최대 RATE_SLOTS*RATE_SLOT_MS 전 값이고, 분당 변화량의 잡음은
+// 이 간격에 반비례하므로 5초 간격 두 샘플로 잴 때보다 그 간격/5초 배만큼 줄어든다.
+const int RATE_SLOTS=8;
+const unsigned long RATE_SLOT_MS=15000;
+
+struct RateBase
+{
+ int16_t value[RATE_SLOTS];
+ unsigned long ms[RATE_SLOTS];
+ uint8_t head;  // 다음에 쓸 칸 (가득 차면 가장 오래된 칸)
+ uint8_t count;
+};
+
+RateBase rateBase[3];
+
+unsigned long heaterOnSinceMs=0;
+centi_t heaterOnWater=SENSOR_NA;
+
+// 발생/해제/확인 이벤트 피드
+enum AlarmEventType{AE_RAISE,AE_CLEAR,AE_ACK};
+const char* const ALARM_EVENT_NAMES[]={"raise","clear","ack"};
+
+struct AlarmEvent
+{
+ uint32_t seq;
+ uint32_t epoch;
+ uint8_t rule;
+ uint8_t type;
+ int32_t value;
+};
+
+const int ALARM_EVENTS=32;
+AlarmEvent alarmEvents[ALARM_EVENTS];
+uint32_t alarmSeq=0;
+
+// 규칙 값 문자열 (STALE 은 초, 나머지는 입력 단위)
+int alarmFormat(char *buf,int rule,int32_t v)
+{
+ const AlarmRule &r=ALARM_RULES[rule];
+ if(r.kind==AK_STALE) return fmtFixed(buf,v,0,0);
+ uint8_t sc=ALARM_INPUT_SCALE[r.input];
+ return fmtFixed(buf,v,sc,sc);
+}
+
+void alarmEvent(int rule,int type,int32_t v)
+{
+ AlarmEvent &e=alarmEvents[alarmSeq%ALARM_EVENTS];
+
+ e.seq=++alarmSeq;
+ e.epoch=rtcNow.unixtime();
+ e.rule=rule;
+ e.type=type;
+ e.value=v;
+
+ char vb[16];
+ alarmFormat(vb,rule,v);
+
+ mqttPublishf(MT_EVENT,"\"alarm\":\"%s\",\"type\":\"%s\",\"value\":%s",
+ ALARM_RULES[rule].name,ALARM_EVENT_NAMES[type],vb);
+
+ if(type==AE_RAISE) LOG_W(CAT_SYSTEM,"[ALARM] %s raised (%s)",ALARM_RULES[rule].name,vb);
+ else if(type==AE_CLEAR) LOG_W(CAT_SYSTEM,"[ALARM] %s cleared (%s)",ALARM_RULES[rule].name,vb);
+}
+
+// 조건 판정. 입력이 없으면(SENSOR_NA) 변화 없음으로 -1
+int alarmCondition(int i,const int16_t in[3],unsigned long now)
+{
+ const AlarmRule &r=ALARM_RULES[i];
+ AlarmState &st=alarmStates[i];
+ int16_t v=in[r.input];
+
+ switch(r.kind)
+ {
+  case AK_HIGH:
+   if(v==SENSOR_NA) return -1;
+   st.value=v;
+   return st.active?v>r.clear:v>r.threshold;
+
+  case AK_LOW:
+   if(v==SENSOR_NA) return -1;
+   st.value=v;
+   return st.active?v<r.clear:v<r.threshold;
+
+  case AK_RATE:
+  {
+   const RateBase &b=rateBase[r.input];
+   if(v==SENSOR_NA || b.count<RATE_SLOTS) return -1;
+
+   int o=b.head;
+   st.value=(int32_t)((int64_t)(v-b.value[o])*60000/(int32_t)(now-b.ms[o]));
+   return abs(st.value)>r.threshold;
+  }
+
+  case AK_STALE:
+   st.value=(now-alarmValidMs[r.input])/1000;
+   return st.value>r.threshold;
+
+  case AK_STUCK_HEATER:
+   if(!heaterState || v==SENSOR_NA || heaterOnWater==SENSOR_NA) return 0;
+   st.value=v-heaterOnWater;
+   return now-heaterOnSinceMs>=r.window*1000UL && st.value<r.threshold;
+ }
+
+ return -1;
+}
+
+void alarmsEvaluate(centi_t t,permille_t h,centi_t w)
+{
+ unsigned long now=millis();
+
+ const int16_t in[3]={waterValid(w)?w:SENSOR_NA,t,h};
+
+ for(int k=0;k<3;k++)
+ if(in[k]!=SENSOR_NA) alarmValidMs[k]=now;
+
+ // 히터 ON 시점의 수온을 기준으로 상승 여부를 본다
+ if(heaterState && !heaterOnSinceMs)
+ {
+  heaterOnSinceMs=now;
+  heaterOnWater=in[AI_WATER];
+ }
+ else if(!heaterState) heaterOnSinceMs=0;
+
+ for(int i=0;i<ALARM_COUNT;i++)
+ {
+  const AlarmRule &r=ALARM_RULES[i];
+  AlarmState &st=alarmStates[i];
+
+  int c=alarmCondition(i,in,now);
+  if(c<0) continue;
+
+  // 현재 상태와 다른 판정이 hold 번 연속되면 전환
+  if((bool)c==st.active)
+  {
+   st.count=0;
+   continue;
+  }
+
+  if(++st.count<r.hold) continue;
+
+  st.count=0;
+  st.active=c;
+
+  if(st.active)
+  {
+   if(r.latch) st.latched=true;
+   alarmEvent(i,AE_RAISE,st.value);
+  }
+  else alarmEvent(i,AE_CLEAR,st.value);
+ }
+
+ for(int k=0;k<3;k++)
+ {
+  RateBase &b=rateBase[k];
+  int last=(b.head+RATE_SLOTS-1)%RATE_SLOTS;
+
+  if(in[k]==SENSOR_NA || (b.count && now-b.ms[last]<RATE_SLOT_MS)) continue;
+
+  b.value[b.head]=in[k];
+  b.ms[b.head]=now;
+  b.head=(b.head+1)%RATE_SLOTS;
+  if(b.count<RATE_SLOTS) b.count++;
+ }
+}
+
+bool alarmRaised(int i)
+{
+ return alarmStates[i].active || alarmStates[i].latched;
+}
+
+// ---------------- 통계 ----------------
+// 센서별 1시간/24시간/7일 창 통계. 창마다 고정 개수의 버킷(5분/1시간/6시간)을 돌려 쓰며,
+// 샘플은 각 창의 현재 버킷에만 더한다(O(1)). 평균/분산은 Welford, 버킷 합치기는 Chan 공식.
+// 백분위는 고정 히스토그램을 합쳐 bin 안에서 보간한다. bin 폭은 센서 분해능의 배수로 맞추고
+// (수온 0.125도 = DS18B20 2 LSB, 공기 0.5도, 습도 2%) 제어 구간 주변만 덮는다.
+// 첫/마지막 bin 은 범위 밖 꼬리이며 창의 min/max 까지로 보간한다.
+// 값과 범위는 센서 고정소수점 단위(수온/공기 centi, 습도 per-mille).
+enum StatSensor{SS_WATER,SS_AIR,SS_HUM,SS_COUNT};
+const char* const STAT_SENSOR_NAMES[SS_COUNT]={"water","air","hum"};
+const uint8_t STAT_SCALE[SS_COUNT]={2,2,1};
+
+const int STAT_BINS=64;
+const int16_t STAT_CORE_LO[SS_COUNT]={1950,500,0};          // 19.50도 / 5.0도 / 0%
+const float STAT_BIN_WIDTH[SS_COUNT]={12.5f,50.0f,20.0f};   // 코어 62칸: ~27.25도 / ~36도 / 100%
+const int STAT_WINDOWS=3;
+const char* const STAT_WINDOW_NAMES[STAT_WINDOWS]={"1h","24h","7d"};
+const uint32_t STAT_BUCKET_SEC[STAT_WINDOWS]={300,3600,6UL*3600UL};
+const int STAT_BUCKETS[STAT_WINDOWS]={12,24,28};
+const int STAT_BUCKET_TOTAL=12+24+28;
+
+struct StatBucket
+{
+ uint32_t id;    // unixtime / 버킷 길이
+ uint16_t n;
+ float mean;
+ float m2;
+ int16_t min;
+ int16_t max;
+ uint16_t hist[STAT_BINS];
+};
+
+StatBucket statBuckets[SS_COUNT][STAT_BUCKET_TOTAL];
+
+int statOffset(int w)
+{
+ int o=0;
+ for(int i=0;i<w;i++) o+=STAT_BUCKETS[i];
+ return o;
+}
+
+int statBin(int sensor,int16_t v)
+{
+ if(v<STAT_CORE_LO[sensor]) return 0;
+
+ int b=1+(int)((v-STAT_CORE_LO[sensor])/STAT_BIN_WIDTH[sensor]);
+ return b<STAT_BINS?b:STAT_BINS-1;
+}
+
+void statAdd(int sensor,int16_t v,uint32_t epoch)
+{
+ if(v==SENSOR_NA) return;
+
+ int bin=statBin(sensor,v);
+
+ for(int w=0;w<STAT_WINDOWS;w++)
+ {
+  uint32_t id=epoch/STAT_BUCKET_SEC[w];
+  StatBucket &b=statBuckets[sensor][statOffset(w)+id%STAT_BUCKETS[w]];
+
+  if(b.id!=id)
+  {
+   memset(&b,0,sizeof(b));
+   b.id=id;
+   b.min=v;
+   b.max=v;
+  }
+
+  if(b.n==0xFFFF) continue;
+
+  b.n++;
+  float d=v-b.mean;
+  b.mean+=d/b.n;
+  b.m2+=d*(v-b.mean);
+
+  if(v<b.min) b.min=v;
+  if(v>b.max) b.max=v;
+  if(b.hist[bin]<0xFFFF) b.hist[bin]++;
+ }
+}
+
+struct StatSummary
+{
+ uint32_t n;
+ float mean;
+ float m2;
+ int16_t min;
+ int16_t max;
+ uint32_t hist[STAT_BINS];
+};
+
+void statWindow(int sensor,int w,uint32_t epoch,StatSummary &out)
+{
+ memset(&out,0,sizeof(out));
+
+ uint32_t cur=epoch/STAT_BUCKET_SEC[w];
+
+ for(int k=0;k<STAT_BUCKETS[w];k++)
+ {
+  const StatBucket &b=statBuckets[sensor][statOffset(w)+k];
+
+  if(!b.n || b.id>cur || cur-b.id>=(uint32_t)STAT_BUCKETS[w]) continue;
+
+  uint32_t n=out.n+b.n;
+  float d=b.mean-out.mean;
+
+  out.mean+=d*b.n/n;
+  out.m2+=b.m2+d*d*(float)out.n*b.n/n;
+
+  if(!out.n || b.min<out.min) out.min=b.min;
+  if(!out.n || b.max>out.max) out.max=b.max;
+
+  out.n=n;
+
+  for(int i=0;i<STAT_BINS;i++) out.hist[i]+=b.hist[i];
+ }
+}
+
+// 결과는 센서 단위, 샘플이 없으면 SENSOR_NA
+int32_t statPercentile(int sensor,const StatSummary &s,float p)
+{
+ if(!s.n) return SENSOR_NA;
+
+ float target=p*s.n;
+ float width=STAT_BIN_WIDTH[sensor];
+ uint32_t cum=0;
+
+ for(int i=0;i<STAT_BINS;i++)
+ {
+  if(cum+s.hist[i]>=target && s.hist[i])
+  {
+   float lo=STAT_CORE_LO[sensor]+width*(i-1);
+   float hi=lo+width;
+
+   if(i==0)
+   {
+    lo=s.min;
+    hi=STAT_CORE_LO[sensor];
+   }
+   else if(i==STAT_BINS-1) hi=s.max;
+
+   int32_t v=lroundf(lo+(hi-lo)*(target-cum)/s.hist[i]);
+   if(v<s.min) v=s.min;
+   if(v>s.max) v=s.max;
+   return v;
+  }
+  cum+=s.hist[i];
+ }
+
+ return s.max;
+}
+
+// ---------------- UDP 텔레메트리 ----------------
+// 수집기용 고정 레이아웃 바이너리 데이터그램을 브로드캐스트한다 (STA 연결 시 STA 망, 아니면 AP 망).
+// 필드는 리틀엔디언, 값은 0.01 단위 정수이며 TELEMETRY_NA 는 측정 실패.
+// 레이아웃을 바꾸면 TELEMETRY_VERSION 을 올린다. 수신기: tools/udp_receiver.cpp
+const uint32_t TELEMETRY_MAGIC=0x4D524146;   // "FARM"
+const uint8_t TELEMETRY_VERSION=1;
+const uint16_t TELEMETRY_PORT=47000;
+const int16_t TELEMETRY_NA=SENSOR_NA;
+
+struct __attribute__((packed)) TelemetryPacket
+{
+ uint32_t magic;
+ uint8_t version;
+ uint8_t size;        // sizeof(TelemetryPacket)
+ uint16_t relays;     // bit = RelayId
+ uint32_t seq;        // 부팅 후 1부터
+ uint32_t uptimeMs;
+ uint32_t epoch;      // RTC unixtime
+ int16_t air;         // 0.01 C
+ int16_t hum;         // 0.01 %
+ int16_t water;       // 0.01 C
+ uint16_t pumpRemain; // 초
+ uint32_t alarms;     // bit = 경보 규칙 (발생 또는 래치)
+};
+
+static_assert(sizeof(TelemetryPacket)==32,"telemetry layout");
+
+WiFiUDP telemetryUdp;
+uint32_t telemetrySeq=0;
+unsigned long telemetryIntervalMs=0;   // 0=끔, /api/telemetry 로 설정 (저장됨)
+unsigned long lastTelemetry=0;
+
+void handleTelemetry()
+{
+ if(!telemetryIntervalMs || millis()-lastTelemetry<telemetryIntervalMs) return;
+
+ lastTelemetry=millis();
+
+ TelemetryPacket p;
+
+ p.magic=TELEMETRY_MAGIC;
+ p.version=TELEMETRY_VERSION;
+ p.size=sizeof(p);
+ p.relays=(heaterState<<RID_HEATER)|(fanState<<RID_FAN)|(ledState<<RID_LED)|(pumpState.load()<<RID_PUMP);
+ p.seq=++telemetrySeq;
+ p.uptimeMs=millis();
+ p.epoch=rtcNow.unixtime();
+ p.air=lastAirTemp;
+ p.hum=(lastHum==SENSOR_NA)?TELEMETRY_NA:lastHum*10;
+ p.water=waterValid(lastWaterTemp)?lastWaterTemp:TELEMETRY_NA;
+ p.pumpRemain=getPumpRemainMs()/1000;
+ p.alarms=0;
+
+ for(int i=0;i<ALARM_COUNT && i<32;i++)
+ if(alarmRaised(i)) p.alarms|=1UL<<i;
+
+ IPAddress dst=(WiFi.status()==WL_CONNECTED)?WiFi.broadcastIP():WiFi.softAPBroadcastIP();
+
+ telemetryUdp.beginPacket(dst,TELEMETRY_PORT);
+ telemetryUdp.write((const uint8_t*)&p,sizeof(p));
+ telemetryUdp.endPacket();
+}
+
+// ---------------- 센서 이력 ----------------
+// 5초 샘플(시각, 공기 온도, 습도, 수온)을 256바이트 고정 블록에 비트 단위로 압축해 쌓는다 (Gorilla 방식).
+// 시각은 delta-of-delta, 값은 직전 값과의 차이를 가변 길이로 적는다. 한 블록 안에서만 이어지므로
+// 블록마다 독립적으로 풀 수 있고, 첫 샘플은 헤더에 그대로 들어간다.
+//  시각 dod : 0 → '0' | 7비트 → '10' | 12비트 → '110' | 32비트 → '111'
+//  값 차이  : 0 → '0' | 6비트 → '10' | 16비트 → '11'  (int16 로 감아서, SENSOR_NA 전환도 그대로 표현)
+enum HistChannel{HC_AIR,HC_HUM,HC_WATER,HC_COUNT};
+const char* const HIST_CHANNEL_NAMES[HC_COUNT]={"air","hum","water"};
+const uint8_t HIST_SCALE[HC_COUNT]={2,1,2};
+
+const int HIST_BLOCKS=64;
+const int HIST_BLOCK_BYTES=256;
+const int HIST_SAMPLE_MAX_BITS=3+32+HC_COUNT*(2+16);
+
+struct HistBlock
+{
+ uint32_t t0;
+ int16_t v0[HC_COUNT];
+ uint16_t n;       // 샘플 수
+ uint16_t bits;    // data 에 쓴 비트 수
+ uint8_t data[HIST_BLOCK_BYTES-14];
+};
+
+HistBlock histBlocks[HIST_BLOCKS];
+uint32_t histBlockCount=0;    // 누적 블록 수, 링 위치는 % HIST_BLOCKS
+
+// 쓰기 쪽 이어붙이기 상태 (현재 블록의 마지막 샘플)
+uint32_t histPrevT=0;
+int32_t histPrevDelta=0;
+int16_t histPrevV[HC_COUNT];
+
+void histPutBits(HistBlock &b,uint32_t v,uint8_t n)
+{
+ while(n)
+ {
+  uint8_t room=8-(b.bits&7);
+  uint8_t k=n<room?n:room;
+
+  b.data[b.bits>>3]|=((v>>(n-k))&((1u<<k)-1))<<(room-k);
+  b.bits+=k;
+  n-=k;
+ }
+}
+
+uint32_t histGetBits(const HistBlock &b,uint16_t &pos,uint8_t n)
+{
+ uint32_t v=0;
+
+ while(n)
+ {
+  uint8_t room=8-(pos&7);
+  uint8_t k=n<room?n:room;
+
+  v=(v<<k)|((b.data[pos>>3]>>(room-k))&((1u<<k)-1));
+  pos+=k;
+  n-=k;
+ }
+
+ return v;
+}
+
+int32_t histSignExtend(uint32_t v,uint8_t n)
+{
+ return n>=32?(int32_t)v:(int32_t)(v<<(32-n))>>(32-n);
+}
+
+void histAppend(uint32_t t,const int16_t v[HC_COUNT])
+{
+ HistBlock *b=histBlockCount?&histBlocks[(histBlockCount-1)%HIST_BLOCKS]:NULL;
+
+ if(!b || b->bits+HIST_SAMPLE_MAX_BITS>(int)sizeof(b->data)*8)
+ {
+  b=&histBlocks[histBlockCount++%HIST_BLOCKS];
+  memset(b,0,sizeof(*b));
+
+  b->t0=t;
+  memcpy(b->v0,v,sizeof(b->v0));
+  b->n=1;
+  histPrevDelta=0;
+ }
+ else
+ {
+  int32_t delta=(int32_t)(t-histPrevT);
+  int32_t dod=delta-histPrevDelta;
+
+  if(dod==0) histPutBits(*b,0,1);
+  else if(dod>=-64 && dod<=63)
+  {
+   histPutBits(*b,2,2);
+   histPutBits(*b,dod,7);
+  }
+  else if(dod>=-2048 && dod<=2047)
+  {
+   histPutBits(*b,6,3);
+   histPutBits(*b,dod,12);
+  }
+  else
+  {
+   histPutBits(*b,7,3);
+   histPutBits(*b,dod,32);
+  }
+
+  for(int c=0;c<HC_COUNT;c++)
+  {
+   int16_t dv=(int16_t)(v[c]-histPrevV[c]);
+
+   if(dv==0) histPutBits(*b,0,1);
+   else if(dv>=-32 && dv<=31)
+   {
+    histPutBits(*b,2,2);
+    histPutBits(*b,dv,6);
+   }
+   else
+   {
+    histPutBits(*b,3,2);
+    histPutBits(*b,(uint16_t)dv,16);
+   }
+  }
+
+  b->n++;
+  histPrevDelta=delta;
+ }
+
+ histPrevT=t;
+ memcpy(histPrevV,v,sizeof(histPrevV));
+}
+
+uint32_t histOldestBlock()
+{
+ return histBlockCount>HIST_BLOCKS?histBlockCount-HIST_BLOCKS:0;
+}
+
+// 블록을 차례로 푸는 읽기 커서
+struct HistReader
+{
+ uint32_t block;   // 누적 블록 번호
+ uint16_t i;       // 블록 안 샘플 번호
+ uint16_t pos;     // 비트 위치
+ uint32_t t;
+ int32_t delta;
+ int16_t v[HC_COUNT];
+};
+
+// from 을 포함하는 블록부터 (블록 시작 시각으로 이분 탐색)
+void histSeek(HistReader &r,uint32_t from)
+{
+ uint32_t lo=histOldestBlock(),hi=histBlockCount;
+
+ while(hi-lo>1)
+ {
+  uint32_t mid=lo+(hi-lo)/2;
+  if(histBlocks[mid%HIST_BLOCKS].t0<=from) lo=mid;
+  else hi=mid;
+ }
+
+ r.block=lo;
+ r.i=0;
+}
+
+bool histNext(HistReader &r)
+{
+ while(r.block<histBlockCount)
+ {
+  const HistBlock &b=histBlocks[r.block%HIST_BLOCKS];
+
+  if(r.i<b.n)
+  {
+   if(r.i==0)
+   {
+    r.t=b.t0;
+    r.delta=0;
+    r.pos=0;
+    memcpy(r.v,b.v0,sizeof(r.v));
+   }
+   else
+   {
+    int32_t dod;
+
+    if(!histGetBits(b,r.pos,1)) dod=0;
+    else if(!histGetBits(b,r.pos,1)) dod=histSignExtend(histGetBits(b,r.pos,7),7);
+    else if(!histGetBits(b,r.pos,1)) dod=histSignExtend(histGetBits(b,r.pos,12),12);
+    else dod=(int32_t)histGetBits(b,r.pos,32);
+
+    r.delta+=dod;
+    r.t+=r.delta;
+
+    for(int c=0;c<HC_COUNT;c++)
+    {
+     if(!histGetBits(b,r.pos,1)) continue;
+
+     if(!histGetBits(b,r.pos,1)) r.v[c]+=histSignExtend(histGetBits(b,r.pos,6),6);
+     else r.v[c]+=(int16_t)histGetBits(b,r.pos,16);
+    }
+   }
+
+   r.i++;
+   return true;
+  }
+
+  r.block++;
+  r.i=0;
+ }
+
+ return false;
+}
+
+// 남아 있는 블록의 샘플 수와 바이트 수 (헤더 포함, 빈 꼬리 제외)
+void histUsage(uint32_t &samples,uint32_t &bytes)
+{
+ samples=0;
+ bytes=0;
+
+ for(uint32_t k=histOldestBlock();k<histBlockCount;k++)
+ {
+  const HistBlock &b=histBlocks[k%HIST_BLOCKS];
+  samples+=b.n;
+  bytes+=HIST_BLOCK_BYTES-sizeof(b.data)+(b.bits+7)/8;
+ }
+}
+
+// ---------------- 버스트 캡처 ----------------
+// 진단용: 정해진 시간 동안 DS18B20 을 낮은 해상도로 비동기 변환해 끝나는 대로 다시 요청하고,
+// DHT11 은 센서 한계인 1초마다 강제로 읽어 미리 잡아 둔 버퍼에 쌓는다.
+// 변환을 기다리며 멈추지 않으므로 loop 와 제어는 그대로 돌고, 끝나면 12비트/동기 변환으로 되돌린다.
+// 제어는 12비트 값만 쓴다. 9~11비트(0.5~0.125도 단위)는 히터 불감대와 같거나 비슷해서
+// 릴레이를 흔들 수 있으므로, 그동안은 시작 직전 12비트 수온을 그대로 두고(최대 120초)
+// 센서가 빠졌을 때(SENSOR_NA)만 넘겨 failsafe 가 동작하게 한다.
+enum BurstState{BS_IDLE,BS_RUNNING,BS_DONE};
+enum BurstChannel{BC_WATER,BC_AIR,BC_HUM,BC_COUNT};
+const char* const BURST_STATE_NAMES[3]={"idle","running","done"};
+const char* const BURST_CHANNEL_NAMES[BC_COUNT]={"water","air","hum"};
+const uint8_t BURST_SCALE[BC_COUNT]={2,2,1};
+
+const int BURST_SAMPLES=1024;
+const uint16_t BURST_MAX_SEC=120;
+const unsigned long DHT_MIN_INTERVAL_MS=1000;   // DHT11 샘플링 주기 한계
+
+struct BurstSample
+{
+ uint32_t ms;      // 시작으로부터
+ int16_t value;    // centi / per-mille
+ uint8_t channel;
+};
+
+BurstSample burstBuf[BURST_SAMPLES];
+int burstCount=0;
+uint8_t burstState=BS_IDLE;
+uint8_t burstResolution=9;
+unsigned long burstStartMs=0;
+unsigned long burstDurationMs=0;
+unsigned long burstLastDht=0;
+unsigned long burstConvStart=0;
+uint16_t burstMaxConvMs=0;          // 요청~완료 최대 시간
+centi_t burstLastWater=SENSOR_NA;
+centi_t burstHoldWater=SENSOR_NA;   // 12비트 미만일 때 제어가 쓰는 시작 직전 수온
+bool burstOverflow=false;
+
+// 버퍼가 차기 전에 끝나는 최대 시간(초). 수온은 변환 시간(9비트 94ms ~ 12비트 750ms)마다,
+// DHT 는 1초마다 두 개씩 쌓인다. 9비트는 분당 약 765개라 80초, 10비트부터는 BURST_MAX_SEC.
+// 스펙보다 빨리 변환하는 센서가 있으므로 넘치면 그 자리에서 멈추는 것은 그대로 둔다.
+uint16_t burstMaxSec(uint8_t resolution)
+{
+ unsigned long convMs=750UL>>(12-resolution);
+ unsigned long perMin=60000UL/convMs+2*60000UL/DHT_MIN_INTERVAL_MS;
+ unsigned long sec=(unsigned long)BURST_SAMPLES*60UL/perMin;
+
+ return sec<BURST_MAX_SEC?sec:BURST_MAX_SEC;
+}
+
+void burstRecord(uint8_t ch,int16_t v)
+{
+ if(burstCount>=BURST_SAMPLES)
+ {
+  burstOverflow=true;
+  return;
+ }
+
+ BurstSample &b=burstBuf[burstCount++];
+ b.ms=millis()-burstStartMs;
+ b.value=v;
+ b.channel=ch;
+}
+
+bool burstStart(uint16_t sec,uint8_t resolution)
+{
+ if(burstState==BS_RUNNING) return false;
+
+ burstResolution=resolution;
+ burstDurationMs=(unsigned long)sec*1000UL;
+ burstStartMs=millis();
+ burstLastDht=burstStartMs-DHT_MIN_INTERVAL_MS;
+ burstCount=0;
+ burstMaxConvMs=0;
+ burstOverflow=false;
+ burstLastWater=lastWaterTemp;
+ burstHoldWater=lastWaterTemp;
+
+ waterSensor.setResolution(resolution);
+ waterSensor.setWaitForConversion(false);
+ waterSensor.requestTemperatures();
+ burstConvStart=millis();
+
+ burstState=BS_RUNNING;
+ LOG_I(CAT_SENSOR,"[BURST] start %us res=%u",sec,resolution);
+
+ return true;
+}
+
+void burstStop()
+{
+ waterSensor.setResolution(12);
+ waterSensor.setWaitForConversion(true);
+
+ burstState=BS_DONE;
+ LOG_I(CAT_SENSOR,"[BURST] done %d samples%s",burstCount,burstOverflow?" (buffer full)":"");
+}
+
+void handleBurst()
+{
+ if(burstState!=BS_RUNNING) return;
+
+ unsigned long now=millis();
+
+ if(waterSensor.isConversionComplete())
+ {
+  float wc=waterSensor.getTempCByIndex(0);
+  uint16_t conv=now-burstConvStart;
+
+  if(conv>burstMaxConvMs) burstMaxConvMs=conv;
+
+  burstLastWater=(wc==DEVICE_DISCONNECTED_C)?SENSOR_NA:toCenti(wc);
+  burstRecord(BC_WATER,burstLastWater);
+
+  waterSensor.requestTemperatures();
+  burstConvStart=now;
+ }
+
+ if(now-burstLastDht>=DHT_MIN_INTERVAL_MS)
+ {
+  burstLastDht=now;
+  burstRecord(BC_AIR,toCenti(dht.readTemperature(false,true)));
+  burstRecord(BC_HUM,toPermille(dht.readHumidity()));
+ }
+
+ if(now-burstStartMs>=burstDurationMs || burstOverflow) burstStop();
+}
+
+// ---------------- 센서 파이프라인 ----------------
+// 수집(acquireSensors) → sampleRing → 제어(controlSensors) → logRing → 로그(logDrain) → serialRing → serialTx
+// 각 링은 생산 단계 하나와 소비 단계 하나만 만진다. 재생 도구가 결정적으로 돌도록 세 단계는
+// loop 에서 차례로 부르고, UART 출력만 core 0 태스크다. 그래서 sampleRing/logRing 의 양쪽이
+// 실제로 동시에 도는 경우는 tools/spsc_test.cpp 가 따로 확인한다.
+struct SensorSample
+{
+ uint32_t epoch;
+ centi_t air;
+ permille_t hum;
+ centi_t water;
+};
+
+SpscRing<SensorSample,8> sampleRing;
+
+// 수집: 5초마다 센서를 읽어 샘플 하나를 넣는다
+void acquireSensors()
+{
+ if(millis()-lastSensorLog<5000) return;
+
+ lastSensorLog=millis();
+
+ SensorSample s;
+ s.epoch=rtcNow.unixtime();
+ s.hum=toPermille(dht.readHumidity());
+ s.air=toCenti(dht.readTemperature());
+
+ // 버스트 중에는 진행 중인 비동기 변환을 건드리지 않는다. 12비트 미만이면 시작 직전 값을 유지
+ if(burstState==BS_RUNNING)
+ s.water=(burstResolution==12 || burstLastWater==SENSOR_NA)?burstLastWater:burstHoldWater;
+ else
+ {
+  waterSensor.requestTemperatures();
+  float wc=waterSensor.getTempCByIndex(0);
+  s.water=(wc==DEVICE_DISCONNECTED_C)?SENSOR_NA:toCenti(wc);
+ }
+
+ sampleRing.push(s);
+}
+
+// 제어: 샘플마다 최근값/경보/통계/이력을 갱신하고 수온 제어를 돌린다
+void controlSensors()
+{
+ SensorSample s;
+
+ while(sampleRing.pop(s))
+ {
+  centi_t t=s.air;
+  permille_t h=s.hum;
+  centi_t w=s.water;
+
+  lastAirTemp=t;
+  lastHum=h;
+  lastWaterTemp=w;
+
+  traceSensor(t,h,w);
+  alarmsEvaluate(t,h,w);
+
+  if(waterValid(w)) statAdd(SS_WATER,w,s.epoch);
+  statAdd(SS_AIR,t,s.epoch);
+  statAdd(SS_HUM,h,s.epoch);
+
+  const int16_t hv[HC_COUNT]={t,h,waterValid(w)?w:SENSOR_NA};
+  histAppend(s.epoch,hv);
+
+  mqttSample(t,h,w);
+
+  if(h==SENSOR_NA || t==SENSOR_NA) dhtErrors++;
+
+  LogEvent e={};
+  e.type=LE_SENSOR;
+  e.air=t;
+  e.hum=h;
+  e.water=w;
+  logRing.push(e);
+
+  if(!waterValid(w))
+  {
+   waterErrors++;
+   relaySet(RID_HEATER,false,RC_FAILSAFE);
+   relaySet(RID_FAN,false,RC_FAILSAFE);
+
+   e.type=LE_WATER_FAIL;
+   logRing.push(e);
+
+   continue;
+  }
+
+  tuneSample(w,s.epoch);
+  handleWaterControl(w);
+ }
+}
+
+// ---------------- 메모리 샘플 ----------------
+uint16_t stackTaskFree(int t)
+{
+ TaskHandle_t task=NULL;
+
+ if(t==STK_SERIAL) task=serialTaskHandle;
+#if MQTT_ENABLE
+ if(t==STK_MQTT) task=mqttTaskHandle;
+#endif
+
+ if(t!=STK_LOOP && !task) return STACK_NA;
+
+ unsigned v=uxTaskGetStackHighWaterMark(task);
+ return v<STACK_NA?v:STACK_NA-1;
+}
+
+void handleHeapSample()
+{
+ if(lastHeapSample && millis()-lastHeapSample<HEAP_SAMPLE_INTERVAL) return;
+
+ lastHeapSample=millis();
+
+ HeapSample &h=heapHistory[heapHead];
+
+ h.ms=lastHeapSample;
+ h.freeHeap=ESP.getFreeHeap();
+ h.largest=ESP.getMaxAllocHeap();
+ for(int t=0;t<STK_COUNT;t++) h.stackFree[t]=stackTaskFree(t);
+ h.frag=h.freeHeap?100-(uint8_t)((uint64_t)h.largest*100/h.freeHeap):0;
+
+ heapHead=(heapHead+1)%HEAP_HISTORY;
+ if(heapCount<HEAP_HISTORY) heapCount++;
+
+ if(h.largest<heapMinLargest) heapMinLargest=h.largest;
+ for(int t=0;t<STK_COUNT;t++)
+ if(h.stackFree[t]<stackMinFree[t]) stackMinFree[t]=h.stackFree[t];
+
+ if(!heapFragAlert && h.frag>=HEAP_FRAG_ALERT)
+ {
+  heapFragAlert=true;
+  LOG_W(CAT_SYSTEM,"[HEAP] FRAGMENTED %u%% free=%lu largest=%lu",
+  h.frag,(unsigned long)h.freeHeap,(unsigned long)h.largest);
+ }
+ else if(heapFragAlert && h.frag<=HEAP_FRAG_CLEAR)
+ {
+  heapFragAlert=false;
+  LOG_I(CAT_SYSTEM,"[HEAP] fragmentation normal %u%%",h.frag);
+ }
+}
+
+// ---------------- 상태 ----------------
+void handleStatusLine()
+{
+ if(millis()-lastStatusLog<5000) return;
+
+ lastStatusLog=millis();
+
+ if(!LOG_ON(LOG_INFO,CAT_SYSTEM)) return;
+
+ unsigned long r=getPumpRemainMs();
+ unsigned long sec=r/1000;
+ unsigned long min=sec/60;
+ sec%=60;
+
+ char tb[12],hb[12],wb[12];
+
+ fmtFixed(tb,lastAirTemp,2,1);
+ fmtFixed(hb,lastHum,1,1);
+ fmtFixed(wb,lastWaterTemp,2,2);
+
+ logPrintf(
+ "[%s] T=%sC H=%s%% W=%sC PUMP_REM=%02lu:%02lu HEATER=%s FAN=%s LED=%s PUMP=%s",
+ nowStr(),tb,hb,wb,
+ min,sec,
+ heaterState?"ON":"OFF",
+ fanState?"ON":"OFF",
+ ledState?"ON":"OFF",
+ pumpState.load()?"ON":"OFF");
+}
+
+// ---------------- API ----------------
+// String 으로 복사하지 않고 버퍼를 그대로 보낸다
+void handleLogs()
+{
+ server.send_P(200,"text/plain",logBuffer,logIndex);
+}
+
+// ----------- RTC TIME API -----------
+// ?format=epoch 이면 unixtime 숫자만
+void handleTime()
+{
+ if(server.arg("format")=="epoch") server.send(200,"text/plain",nowEpochStr());
+ else server.send(200,"text/plain",nowStr());
+}
+
+// ---------------- 응답 버퍼 ----------------
+// /metrics, /api/perf 등은 고정 버퍼에 직접 써서 요청 처리 중 힙 할당이 없다.
+char respBuf[4096];
+size_t respLen=0;
+
+void respBegin()
+{
+ respLen=0;
+ respBuf[0]=0;
+}
+
+void respAdd(const char* fmt,...)
+{
+ if(respLen>=sizeof(respBuf)-1) return;
+
+ va_list ap;
+ va_start(ap,fmt);
+ int n=vsnprintf(respBuf+respLen,sizeof(respBuf)-respLen,fmt,ap);
+ va_end(ap);
+
+ if(n<0) return;
+
+ respLen+=n;
+ if(respLen>sizeof(respBuf)-1) respLen=sizeof(respBuf)-1;
+}
+
+void respSend(const char* type)
+{
+ server.send_P(200,type,respBuf,respLen);
+}
+
+// 응답 크기를 모를 때: chunked 전송으로 respBuf 가 찰 때마다 내보낸다.
+void respStreamBegin(const char* type)
+{
+ server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+ server.send(200,type,"");
+ respBegin();
+}
+
+void respStreamFlush(size_t reserve=256)
+{
+ if(respLen+reserve<sizeof(respBuf)) return;
+
+ if(respLen) server.sendContent(respBuf,respLen);
+ respBegin();
+}
+
+void respStreamEnd()
+{
+ respStreamFlush(sizeof(respBuf));
+ server.sendContent("");
+}
+
+// ----------- LOG QUERY API -----------
+// /api/logs/query?tag=HEATER&since=<unixtime>&limit=50
+// 해당 태그 링만 뒤에서부터 훑어 조건에 맞는 최근 limit 줄을 시간순으로 보낸다.
+void handleLogQuery()
+{
+ int tag=logTagByName(server.arg("tag"));
+
+ if(tag<0)
+ {
+  respBegin();
+  respAdd("unknown tag, one of:");
+  for(int i=0;i<LT_COUNT;i++) respAdd(" %s",LOG_TAG_NAMES[i]);
+  respAdd("\n");
+  server.send(400,"text/plain",respBuf);
+  return;
+ }
+
+ uint32_t since=server.hasArg("since")?strtoul(server.arg("since").c_str(),NULL,10):0;
+ long limit=server.hasArg("limit")?server.arg("limit").toInt():50;
+ if(limit<1) limit=1;
+
+ uint32_t count=logIndexCount[tag];
+ uint32_t oldest=count>LOG_INDEX_DEPTH?count-LOG_INDEX_DEPTH:0;
+ uint32_t first=count;
+
+ while(first>oldest && (long)(count-first)<limit)
+ {
+  const LogIndexEntry &e=logIndexRing[tag][(first-1)%LOG_INDEX_DEPTH];
+  if(e.pos<logBase || e.epoch<since) break;
+  first--;
+ }
+
+ respStreamBegin("text/plain");
+
+ for(uint32_t q=first;q<count;q++)
+ {
+  const char* line=logBuffer+(logIndexRing[tag][q%LOG_INDEX_DEPTH].pos-logBase);
+  const char* nl=strchr(line,'\n');
+  int len=nl?nl-line:strlen(line);
+
+  respStreamFlush(len+2);
+  respAdd("%.*s\n",len,line);
+ }
+
+ respStreamEnd();
+}
+
+// ---------------- METRICS ----------------
+// Prometheus text 포맷
+// 메트릭 묶음마다 남은 자리를 보고 chunk 를 내보낸다 (한 묶음은 1KB 이하)
+void metricsHeader(const char* name,const char* type,const char* help)
+{
+ respStreamFlush(1024);
+ respAdd("# HELP %s %s\n# TYPE %s %s\n",name,help,name,type);
+}
+
+void metricsValue(const char* name,const char* labels,float v)
+{
+ if(isnan(v)) respAdd("%s%s NaN\n",name,labels);
+ else respAdd("%s%s %.2f\n",name,labels,v);
+}
+
+void metricsGauge(const char* name,const char* help,float v)
+{
+ metricsHeader(name,"gauge",help);
+ metricsValue(name,"",v);
+}
+
+// 고정소수점 센서값 (SENSOR_NA 는 NaN)
+void metricsFixed(const char* name,const char* help,int16_t v,uint8_t scale)
+{
+ char b[12];
+
+ metricsHeader(name,"gauge",help);
+
+ if(v==SENSOR_NA) respAdd("%s NaN\n",name);
+ else
+ {
+  fmtFixed(b,v,scale,scale);
+  respAdd("%s %s\n",name,b);
+ }
+}
+
+void handleMetrics()
+{
+ respStreamBegin("text/plain; version=0.0.4");
+
+ metricsFixed("farm_air_temperature_celsius","DHT11 air temperature.",lastAirTemp,2);
+ metricsFixed("farm_humidity_percent","DHT11 relative humidity.",lastHum,1);
+ metricsFixed("farm_water_temperature_celsius","DS18B20 water temperature.",
+ waterValid(lastWaterTemp)?lastWaterTemp:SENSOR_NA,2);
+
+ const bool states[RID_COUNT]={heaterState,fanState,ledState,pumpState.load()};
+
+ metricsHeader("farm_relay_on","gauge","Relay state (1=ON).");
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("farm_relay_on{relay=\"%s\"} %d\n",RELAY_NAMES[i],states[i]?1:0);
+
+ metricsHeader("farm_relay_transitions_total","counter","Relay state changes since boot.");
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("farm_relay_transitions_total{relay=\"%s\"} %lu\n",RELAY_NAMES[i],relayTransitions[i]);
+
+ metricsHeader("farm_relay_cycles_total","counter","Relay OFF->ON cycles over the relay's life (persisted).");
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("farm_relay_cycles_total{relay=\"%s\"} %lu\n",RELAY_NAMES[i],(unsigned long)wear.cycles[i]);
+ metricsHeader("farm_relay_held_total","counter","Relay commands deferred by the minimum on/off time (repeats of a pending command count once).");
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("farm_relay_held_total{relay=\"%s\"} %lu\n",RELAY_NAMES[i],relayHeld[i]);
+
+ char hb[12],fb[12];
+ fmtFixed(hb,heaterOffAt,2,2);
+ fmtFixed(fb,fanOffAt,2,2);
+
+ metricsHeader("farm_hysteresis_off_celsius","gauge","Water temperature that switches the relay off (auto-tuned).");
+ respAdd("farm_hysteresis_off_celsius{relay=\"heater\"} %s\n",hb);
+ respAdd("farm_hysteresis_off_celsius{relay=\"fan\"} %s\n",fb);
+ metricsHeader("farm_hysteresis_adjustments_total","counter","Dead-band changes made by auto-tune.");
+ respAdd("farm_hysteresis_adjustments_total %u\n",tune.adjustments);
+
+ metricsHeader("farm_relay_on_seconds_total","counter","Cumulative relay on-time (persisted).");
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("farm_relay_on_seconds_total{relay=\"%s\"} %lu\n",RELAY_NAMES[i],
+ (unsigned long)(energy.totalOnSec[i]+energy.curOnMs[i]/1000));
+
+ metricsHeader("farm_relay_energy_wh_total","counter","Estimated energy from rated wattage x on-time.");
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("farm_relay_energy_wh_total{relay=\"%s\"} %.1f\n",RELAY_NAMES[i],
+ energyWh(i,energy.totalOnSec[i]+energy.curOnMs[i]/1000));
+
+ metricsHeader("farm_alarm_active","gauge","Alarm raised or latched (1) per rule.");
+ for(int i=0;i<ALARM_COUNT;i++)
+ respAdd("farm_alarm_active{alarm=\"%s\"} %d\n",ALARM_RULES[i].name,alarmRaised(i)?1:0);
+
+ metricsHeader("farm_sensor_errors_total","counter","Failed sensor reads since boot.");
+ respAdd("farm_sensor_errors_total{sensor=\"dht11\"} %lu\n",dhtErrors);
+ respAdd("farm_sensor_errors_total{sensor=\"ds18b20\"} %lu\n",waterErrors);
+
+ metricsGauge("farm_pump_remaining_seconds","Time until the next pump switch.",getPumpRemainMs()/1000.0f);
+
+ metricsHeader("farm_loop_duration_seconds","histogram","Duration of one loop() pass.");
+ unsigned long cum=0;
+ for(int i=0;i<LOOP_BUCKET_COUNT;i++)
+ {
+  cum+=loopHist[i];
+  respAdd("farm_loop_duration_seconds_bucket{le=\"%g\"} %lu\n",LOOP_BUCKETS_US[i]/1e6,cum);
+ }
+ respAdd("farm_loop_duration_seconds_bucket{le=\"+Inf\"} %lu\n",loopCount);
+ respAdd("farm_loop_duration_seconds_sum %.6f\n",loopSumUs/1e6);
+ respAdd("farm_loop_duration_seconds_count %lu\n",loopCount);
+
+ metricsHeader("farm_heap_free_bytes","gauge","Current free heap.");
+ respAdd("farm_heap_free_bytes %u\n",(unsigned)ESP.getFreeHeap());
+ metricsHeader("farm_heap_min_free_bytes","gauge","Lowest free heap since boot.");
+ respAdd("farm_heap_min_free_bytes %u\n",(unsigned)ESP.getMinFreeHeap());
+ metricsHeader("farm_heap_largest_block_bytes","gauge","Largest allocatable heap block.");
+ respAdd("farm_heap_largest_block_bytes %u\n",(unsigned)ESP.getMaxAllocHeap());
+ metricsHeader("farm_stack_min_free_bytes","gauge","Lowest task stack high-water mark seen by the 30 s heap sampler.");
+ for(int t=0;t<STK_COUNT;t++)
+ if(stackMinFree[t]!=STACK_NA)
+ respAdd("farm_stack_min_free_bytes{task=\"%s\"} %u\n",STACK_TASK_NAMES[t],(unsigned)stackMinFree[t]);
+
+ metricsHeader("farm_serial_dropped_lines_total","counter","Log lines dropped because the Serial queue was full.");
+ respAdd("farm_serial_dropped_lines_total %lu\n",serialDroppedLines);
+ metricsHeader("farm_serial_dropped_bytes_total","counter","Bytes dropped because the Serial queue was full.");
+ respAdd("farm_serial_dropped_bytes_total %lu\n",(unsigned long)serialRing.dropped());
+ metricsHeader("farm_serial_queue_peak_bytes","gauge","Highest Serial queue fill level.");
+ respAdd("farm_serial_queue_peak_bytes %lu\n",(unsigned long)serialRing.peak());
+
+ // serial 의 peak/dropped 는 예전 이름(farm_serial_queue_peak_bytes, farm_serial_dropped_bytes_total)으로만 낸다
+ metricsHeader("farm_queue_depth","gauge","Pipeline queue fill level (entries).");
+ respAdd("farm_queue_depth{queue=\"sample\"} %u\n",(unsigned)sampleRing.depth());
+ respAdd("farm_queue_depth{queue=\"log\"} %u\n",(unsigned)logRing.depth());
+ respAdd("farm_queue_depth{queue=\"serial\"} %u\n",(unsigned)serialRing.depth());
+ metricsHeader("farm_queue_peak","gauge","Highest pipeline queue fill level (entries).");
+ respAdd("farm_queue_peak{queue=\"sample\"} %u\n",(unsigned)sampleRing.peak());
+ respAdd("farm_queue_peak{queue=\"log\"} %u\n",(unsigned)logRing.peak());
+ metricsHeader("farm_queue_dropped_total","counter","Entries dropped because a pipeline queue was full.");
+ respAdd("farm_queue_dropped_total{queue=\"sample\"} %u\n",(unsigned)sampleRing.dropped());
+ respAdd("farm_queue_dropped_total{queue=\"log\"} %u\n",(unsigned)logRing.dropped());
+
+ #if MQTT_ENABLE
+ metricsGauge("farm_mqtt_connected","MQTT session established (1).",mqttState==MS_CONNECTED);
+ metricsHeader("farm_mqtt_published_total","counter","MQTT messages acknowledged by the broker.");
+ respAdd("farm_mqtt_published_total %lu\n",mqttSent);
+ metricsHeader("farm_mqtt_dropped_total","counter","MQTT messages evicted from the full offline queue.");
+ respAdd("farm_mqtt_dropped_total %lu\n",mqttDropped);
+ metricsHeader("farm_mqtt_queue_bytes","gauge","Bytes waiting in the MQTT offline queue.");
+ respAdd("farm_mqtt_queue_bytes %d\n",mqttUsed);
+ metricsHeader("farm_mqtt_connects_total","counter","Successful MQTT connects since boot.");
+ respAdd("farm_mqtt_connects_total %lu\n",mqttConnects);
+#endif
+
+ metricsHeader("farm_uptime_seconds","counter","Seconds since boot.");
+ respAdd("farm_uptime_seconds %llu\n",(unsigned long long)(esp_timer_get_time()/1000000LL));
+
+ respStreamEnd();
+}
+
+void observeLoop(unsigned long us)
+{
+ int i=0;
+ while(i<LOOP_BUCKET_COUNT && us>LOOP_BUCKETS_US[i]) i++;
+
+ loopHist[i]++;
+ loopCount++;
+ loopSumUs+=us;
+}
+
+// ---------------- TRACE API ----------------
+void traceFormat(char *buf,int16_t v,uint8_t scale)
+{
+ if(v==SENSOR_NA) strcpy(buf,"nan");
+ else fmtFixed(buf,v,scale,scale);
+}
+
+// /api/trace : 텍스트 트레이스 (farm-trace v1)
+void handleTrace()
+{
+ respStreamBegin("text/plain");
+
+ respAdd("# farm-trace v1 epoch=%lu ms=%lu\n",(unsigned long)rtcNow.unixtime(),millis());
+
+ for(int i=0;i<traceCount;i++)
+ {
+  const TraceRecord &r=traceBuf[(traceHead-traceCount+i+TRACE_CAPACITY)%TRACE_CAPACITY];
+
+  if(r.type=='S')
+  {
+   char t[12],h[12],w[12];
+   traceFormat(t,r.a,2);
+   traceFormat(h,r.b,1);
+   traceFormat(w,r.c,2);
+   respAdd("S,%lu,%s,%s,%s\n",(unsigned long)r.ms,t,h,w);
+  }
+  else
+  respAdd("R,%lu,%s,%d\n",(unsigned long)r.ms,RELAY_NAMES[r.id],r.a);
+
+  respStreamFlush();
+ }
+
+ respStreamEnd();
+}
+
+// ---------------- RELAY HISTORY API ----------------
+// /api/relays/at?t=<unixtime> : 그 시각의 릴레이 상태 (기본 현재)
+void handleRelayAt()
+{
+ uint32_t t=server.hasArg("t")?strtoul(server.arg("t").c_str(),NULL,10):rtcNow.unixtime();
+ long k=relayFindCheckpoint(t);
+
+ respBegin();
+
+ if(k<0)
+ {
+  uint32_t lo=relayOldestCheckpoint();
+  respAdd("{\"t\":%lu,\"error\":\"out of range\",\"oldest\":%lu}",(unsigned long)t,
+  lo<relayCheckpointCount?(unsigned long)relayCheckpoints[lo%RELAY_HISTORY_CHECKPOINTS].epoch:0UL);
+  server.send(404,"application/json",respBuf);
+  return;
+ }
+
+ RelayCheckpoint st;
+ uint32_t cpEpoch=relayCheckpoints[k%RELAY_HISTORY_CHECKPOINTS].epoch;
+ int n=relayReplay(k,t,st);
+
+ respAdd("{\"t\":%lu,\"checkpoint\":%lu,\"replayed\":%d,\"relays\":[",
+ (unsigned long)t,(unsigned long)cpEpoch,n);
+
+ for(int i=0;i<RID_COUNT;i++)
+ respAdd("%s{\"name\":\"%s\",\"on\":%s,\"since\":%lu,\"cause\":\"%s\"}",i?",":"",
+ RELAY_NAMES[i],(st.states&(1<<i))?"true":"false",(unsigned long)st.since[i],RELAY_CAUSE_NAMES[st.causes[i]]);
+
+ respAdd("]}");
+ respSend("application/json");
+}
+
+// /api/relays/events?from=<unixtime>&limit=100 : from 이후 전환, 오래된 것부터
+// from 직전 체크포인트부터 재생하므로 from 앞의 이벤트는 많아야 31개만 거친다.
+uint32_t relayEventsFrom=0;
+long relayEventsLeft=0;
+bool relayEventsFirst=true;
+
+void relayEventJson(uint32_t t,const RelayEvent &e)
+{
+ if(t<relayEventsFrom || relayEventsLeft<=0) return;
+
+ respAdd("%s{\"t\":%lu,\"relay\":\"%s\",\"on\":%s,\"cause\":\"%s\"}",relayEventsFirst?"":",",
+ (unsigned long)t,RELAY_NAMES[e.bits&3],(e.bits&4)?"true":"false",RELAY_CAUSE_NAMES[e.bits>>3]);
+
+ relayEventsFirst=false;
+ relayEventsLeft--;
+ respStreamFlush();
+}
+
+void handleRelayEvents()
+{
+ relayEventsFrom=server.hasArg("from")?strtoul(server.arg("from").c_str(),NULL,10):0;
+ relayEventsLeft=server.hasArg("limit")?server.arg("limit").toInt():100;
+ relayEventsFirst=true;
+
+ long k=relayFindCheckpoint(relayEventsFrom);
+ if(k<0) k=relayOldestCheckpoint();
+
+ respStreamBegin("application/json");
+ respAdd("[");
 
-// ---------------- 릴레이 ----------------
-#define RELAY_ON HIGH
-#define RELAY_OFF LOW
+ RelayCheckpoint st;
+ for(uint32_t c=k;c<relayCheckpointCount && relayEventsLeft>0;c++)
+ relayReplay(c,UINT32_MAX,st,relayEventJson);
 
-// ---------------- 핀 ----------------
-#define DHTPIN 13
-#define DHTTYPE DHT11
-#define ONE_WIRE_BUS 27
+ respAdd("]");
+ respStreamEnd();
+}
 
-#define RELAY_HEATER 14
-#define RELAY_FAN 25
-#define RELAY_LED 26
-#define RELAY_PUMP 33
+// ---------------- ENERGY API ----------------
+// /api/energy : 누적/오늘/현재 시간 + 시간별(24) + 일별(31), 오래된 것부터
+void handleEnergyApi()
+{
+ respStreamBegin("application/json");
 
-// ---------------- 객체 ----------------
-RTC_DS3231 rtc;
-DateTime rtcNow;
+ respAdd("{\"watts\":[%.0f,%.0f,%.0f,%.0f],\"relays\":[",
+ RELAY_WATTS[0],RELAY_WATTS[1],RELAY_WATTS[2],RELAY_WATTS[3]);
 
-DHT dht(DHTPIN,DHTTYPE);
+ for(int i=0;i<RID_COUNT;i++)
+ {
+  uint32_t curSec=energy.curOnMs[i]/1000;
+  uint32_t todaySec=energy.today.onSec[i]+curSec;
+  uint32_t totalSec=energy.totalOnSec[i]+curSec;
 
-OneWire oneWire(ONE_WIRE_BUS);
-DallasTemperature waterSensor(&oneWire);
+  respAdd("%s{\"name\":\"%s\",\"totalOnSec\":%lu,\"totalTransitions\":%lu,\"totalWh\":%.1f,"
+  "\"todayOnSec\":%lu,\"todayWh\":%.1f,\"hourOnSec\":%lu,\"hourTransitions\":%u}",
+  i?",":"",RELAY_NAMES[i],(unsigned long)totalSec,(unsigned long)energy.totalTransitions[i],
+  energyWh(i,totalSec),(unsigned long)todaySec,energyWh(i,todaySec),
+  (unsigned long)curSec,(unsigned)energy.curTransitions[i]);
+ }
 
-// ---------------- 수온 기준 ----------------
-const float HEATER_ON=22.0;
-const float HEATER_OFF=22.5;
+ respAdd("],\"hourly\":[");
 
-const float FAN_ON=26.0;
-const float FAN_OFF=25.5;
+ for(int k=0;k<energy.hourCount;k++)
+ {
+  const EnergyHour &h=energy.hours[(energy.hourHead-energy.hourCount+k+ENERGY_HOURS)%ENERGY_HOURS];
 
-// ---------------- 상태 ----------------
-bool heaterState=false;
-bool fanState=false;
-bool ledState=false;
-bool pumpState=false;
+  respAdd("%s{\"t\":%lu,\"onSec\":[%u,%u,%u,%u],\"n\":[%u,%u,%u,%u]}",k?",":"",
+  (unsigned long)h.hour*3600UL,h.onSec[0],h.onSec[1],h.onSec[2],h.onSec[3],
+  h.transitions[0],h.transitions[1],h.transitions[2],h.transitions[3]);
 
-// ---------------- 펌프 ----------------
-unsigned long pumpTimer=0;
+  respStreamFlush();
+ }
 
-// const unsigned long PUMP_ON_TIME=1UL*60UL*1000UL; // 1분
-// const unsigned long PUMP_OFF_TIME=3UL*60UL*1000UL; // 3분
-const unsigned long PUMP_ON_TIME=7UL*1000UL; // 7초
-const unsigned long PUMP_OFF_TIME=1UL*60UL*1000UL; // 1분
+ respAdd("],\"daily\":[");
 
-// ---------------- 로그 타이머 ----------------
-unsigned long lastSensorLog=0;
-unsigned long lastStatusLog=0;
+ for(int k=0;k<energy.dayCount;k++)
+ {
+  const EnergyDay &d=energy.days[(energy.dayHead-energy.dayCount+k+ENERGY_DAYS)%ENERGY_DAYS];
 
-// ---------------- 최근 센서값 ----------------
-float lastAirTemp=NAN;
-float lastHum=NAN;
-float lastWaterTemp=DEVICE_DISCONNECTED_C;
+  respAdd("%s{\"t\":%lu,\"onSec\":[%lu,%lu,%lu,%lu],\"n\":[%u,%u,%u,%u]}",k?",":"",
+  (unsigned long)d.day*86400UL,(unsigned long)d.onSec[0],(unsigned long)d.onSec[1],
+  (unsigned long)d.onSec[2],(unsigned long)d.onSec[3],
+  d.transitions[0],d.transitions[1],d.transitions[2],d.transitions[3]);
 
-// ---------------- 로그 버퍼 ----------------
-char logBuffer[12000];
-int logIndex=0;
+  respStreamFlush();
+ }
 
-// ---------------- 시간 문자열 ----------------
-void getNow(char *buf)
-{
- snprintf(buf,32,"%04d-%02d-%02d %02d:%02d:%02d",
- rtcNow.year(),rtcNow.month(),rtcNow.day(),
- rtcNow.hour(),rtcNow.minute(),rtcNow.second());
+ respAdd("]}");
+
+ respStreamEnd();
 }
 
-// ---------------- 로그 ----------------
-void appendLog(const char* text)
+// ---------------- RELAY WEAR API ----------------
+// /api/relays/wear[?relay=heater&minOn=60&minOff=60&rated=100000]
+// 누적 사이클과 최근 하루 사이클 속도로 정격 수명까지 남은 날수를 계산한다.
+void handleRelayWear()
 {
- int len=strlen(text);
+ if(server.hasArg("relay"))
+ {
+  int id=-1;
+  for(int i=0;i<RID_COUNT;i++)
+  if(server.arg("relay")==RELAY_NAMES[i]) id=i;
 
- if(logIndex+len+1>=12000)
+  long minOn=-1,minOff=-1,rated=0;
+
+  if(id>=0)
+  {
+   minOn=server.hasArg("minOn")?server.arg("minOn").toInt():wear.minOnSec[id];
+   minOff=server.hasArg("minOff")?server.arg("minOff").toInt():wear.minOffSec[id];
+   rated=server.hasArg("rated")?server.arg("rated").toInt():wear.rated[id];
+  }
+
+  if(minOn<0 || minOn>3600 || minOff<0 || minOff>3600 || rated<1)
+  {
+   server.send(400,"text/plain","relay=heater|fan|led|pump, minOn/minOff 0..3600 s, rated>=1\n");
+   return;
+  }
+
+  wear.minOnSec[id]=minOn;
+  wear.minOffSec[id]=minOff;
+  wear.rated[id]=rated;
+  wearSave();
+ }
+
+ respBegin();
+ respAdd("{\"relays\":[");
+
+ for(int i=0;i<RID_COUNT;i++)
  {
-  memmove(logBuffer,logBuffer+2000,10000);
-  logIndex=10000;
+  float perDay=wearCyclesPerDay(i);
+  uint32_t left=wear.cycles[i]<wear.rated[i]?wear.rated[i]-wear.cycles[i]:0;
+
+  respAdd("%s{\"name\":\"%s\",\"on\":%s,\"cycles\":%lu,\"rated\":%lu,\"usedPct\":%.2f,\"cyclesPerDay\":%.1f,",
+  i?",":"",RELAY_NAMES[i],relayIsOn(i)?"true":"false",(unsigned long)wear.cycles[i],
+  (unsigned long)wear.rated[i],100.0f*wear.cycles[i]/wear.rated[i],perDay);
+
+  if(perDay>0) respAdd("\"lifeDays\":%.0f,",left/perDay);
+  else respAdd("\"lifeDays\":null,");
+
+  respAdd("\"minOnSec\":%u,\"minOffSec\":%u,\"held\":%lu}",wear.minOnSec[i],wear.minOffSec[i],relayHeld[i]);
  }
 
- memcpy(&logBuffer[logIndex],text,len);
- logIndex+=len;
+ respAdd("]}");
+ respSend("application/json");
+}
 
- logBuffer[logIndex++]='\n';
- logBuffer[logIndex]=0;
+// ---------------- STATS API ----------------
+void statJson(int32_t v,int sensor)
+{
+ char b[12];
 
- Serial.println(text);
+ if(v==SENSOR_NA) respAdd("null");
+ else
+ {
+  fmtFixed(b,v,STAT_SCALE[sensor],STAT_SCALE[sensor]);
+  respAdd("%s",b);
+ }
 }
 
-// ---------------- 릴레이 로그 ----------------
-void logRelay(const char* name,bool state)
+// /api/stats : {"water":{"1h":{n,min,max,mean,std,p50,p90,p99},...},...}
+void handleStats()
 {
- char t[32];
- char line[80];
+ uint32_t epoch=rtcNow.unixtime();
+ StatSummary st;
 
- getNow(t);
+ respBegin();
+ respAdd("{");
 
- snprintf(line,80,"[%s] [%s] %s",t,name,state?"ON":"OFF");
+ for(int s=0;s<SS_COUNT;s++)
+ {
+  respAdd("%s\"%s\":{",s?",":"",STAT_SENSOR_NAMES[s]);
 
- appendLog(line);
+  for(int w=0;w<STAT_WINDOWS;w++)
+  {
+   statWindow(s,w,epoch,st);
+
+   respAdd("%s\"%s\":{\"n\":%lu,\"min\":",w?",":"",STAT_WINDOW_NAMES[w],(unsigned long)st.n);
+   statJson(st.n?st.min:SENSOR_NA,s);
+   respAdd(",\"max\":");
+   statJson(st.n?st.max:SENSOR_NA,s);
+   respAdd(",\"mean\":");
+   statJson(st.n?lroundf(st.mean):SENSOR_NA,s);
+   respAdd(",\"std\":");
+   statJson(st.n>1?lroundf(sqrtf(st.m2/(st.n-1))):SENSOR_NA,s);
+   respAdd(",\"p50\":");
+   statJson(statPercentile(s,st,0.50f),s);
+   respAdd(",\"p90\":");
+   statJson(statPercentile(s,st,0.90f),s);
+   respAdd(",\"p99\":");
+   statJson(statPercentile(s,st,0.99f),s);
+   respAdd("}");
+  }
+
+  respAdd("}");
+ }
+
+ respAdd("}");
+ respSend("application/json");
 }
 
-// ---------------- 펌프 ----------------
-unsigned long getPumpRemainMs()
+// ---------------- TUNE API ----------------
+// /api/tune?enable=1&target=4 | reset=1 (경계를 기본값으로)
+void handleTuneApi()
 {
- unsigned long target=pumpState?PUMP_ON_TIME:PUMP_OFF_TIME;
- unsigned long elapsed=millis()-pumpTimer;
+ bool changed=false;
+
+ if(server.hasArg("target"))
+ {
+  long v=server.arg("target").toInt();
+
+  if(v<1 || v>60)
+  {
+   server.send(400,"text/plain","target must be 1..60 cycles/h\n");
+   return;
+  }
+
+  tune.targetCph=v;
+  changed=true;
+ }
+
+ if(server.hasArg("enable"))
+ {
+  tune.enabled=server.arg("enable").toInt()!=0;
+  changed=true;
+ }
+
+ if(server.hasArg("reset"))
+ {
+  tune.heaterOff=HEATER_OFF;
+  tune.fanOff=FAN_OFF;
+  tune.adjustments=0;
+  tuneAverageReset(RID_HEATER);
+  tuneAverageReset(RID_FAN);
+  changed=true;
+ }
 
- if(elapsed>=target) return 0;
+ if(changed)
+ {
+  tuneApply();
+  tuneSave();
+ }
+
+ char b[4][12];
+ fmtFixed(b[0],HEATER_ON,2,2);
+ fmtFixed(b[1],heaterOffAt,2,2);
+ fmtFixed(b[2],FAN_ON,2,2);
+ fmtFixed(b[3],fanOffAt,2,2);
+
+ respBegin();
+ respAdd("{\"enabled\":%s,\"target_cph\":%u,\"window_s\":%lu,\"adjustments\":%u,",
+ tune.enabled?"true":"false",tune.targetCph,(unsigned long)TUNE_WINDOW_SEC,tune.adjustments);
+ respAdd("\"heater\":{\"on\":%s,\"off\":%s},\"fan\":{\"on\":%s,\"off\":%s},",b[0],b[1],b[2],b[3]);
+
+ fmtFixed(b[0],tuneAvgCph(RID_HEATER),2,2);
+ fmtFixed(b[1],tuneAvgCph(RID_FAN),2,2);
+ respAdd("\"avg\":{\"heater_cph\":%s,\"heater_windows\":%u,\"fan_cph\":%s,\"fan_windows\":%u},",
+ tuneAvgWindows[RID_HEATER]?b[0]:"null",tuneAvgWindows[RID_HEATER],
+ tuneAvgWindows[RID_FAN]?b[1]:"null",tuneAvgWindows[RID_FAN]);
+
+ if(!tuneLastSec) respAdd("\"last\":null}");
+ else
+ {
+  respAdd("\"last\":{\"seconds\":%lu,\"heater_cycles\":%u,\"fan_cycles\":%u,\"water_min\":",
+  (unsigned long)tuneLastSec,tuneLastCycles[RID_HEATER],tuneLastCycles[RID_FAN]);
+  statJson(tuneLastMin,SS_WATER);
+  respAdd(",\"water_max\":");
+  statJson(tuneLastMax,SS_WATER);
+  respAdd("}}");
+ }
 
- return target-elapsed;
+ respSend("application/json");
 }
 
-void handlePump()
+// ---------------- HISTORY API ----------------
+// /api/history?from=<unixtime>&to=<unixtime>&limit=2000 (기본 최근 1시간)
+// {"blocks":..,"stored":..,"bytes":..,"cols":["t","air","hum","water"],"rows":[[t,air,hum,water],...],"n":..}
+void handleHistory()
 {
- unsigned long now=millis();
- unsigned long target;
+ uint32_t now=rtcNow.unixtime();
+ uint32_t from=server.hasArg("from")?strtoul(server.arg("from").c_str(),NULL,10):now-3600;
+ uint32_t to=server.hasArg("to")?strtoul(server.arg("to").c_str(),NULL,10):now;
+ long limit=server.hasArg("limit")?server.arg("limit").toInt():2000;
+
+ uint32_t samples,bytes;
+ histUsage(samples,bytes);
 
- if(pumpState)
+ respStreamBegin("application/json");
+ respAdd("{\"blocks\":%lu,\"stored\":%lu,\"bytes\":%lu,\"cols\":[\"t\"",
+ (unsigned long)(histBlockCount-histOldestBlock()),(unsigned long)samples,(unsigned long)bytes);
+ for(int c=0;c<HC_COUNT;c++) respAdd(",\"%s\"",HIST_CHANNEL_NAMES[c]);
+ respAdd("],\"rows\":[");
+
+ HistReader r;
+ long n=0;
+ char b[12];
+
+ histSeek(r,from);
+
+ while(n<limit && histNext(r))
  {
-  target=PUMP_ON_TIME;
+  if(r.t<from) continue;
+  if(r.t>to) break;
 
-  if(now-pumpTimer>=target)
-  {
-   pumpState=false;
-   pumpTimer=now;
+  respAdd("%s[%lu",n?",":"",(unsigned long)r.t);
 
-   digitalWrite(RELAY_PUMP,RELAY_OFF);
-   appendLog("[PUMP] OFF");
+  for(int c=0;c<HC_COUNT;c++)
+  {
+   if(r.v[c]==SENSOR_NA) respAdd(",null");
+   else
+   {
+    fmtFixed(b,r.v[c],HIST_SCALE[c],HIST_SCALE[c]);
+    respAdd(",%s",b);
+   }
   }
+
+  respAdd("]");
+  respStreamFlush();
+  n++;
  }
- else
+
+ respAdd("],\"n\":%ld}",n);
+ respStreamEnd();
+}
+
+// ---------------- EXPORT API ----------------
+// /api/export?format=csv|ndjson&from=<unixtime>&to=<unixtime> (기본 전체)
+// 블록을 하나씩 풀어 respBuf(4KB)가 찰 때마다 chunked 로 내보내므로 기간과 무관하게 메모리는 일정하다.
+void handleExport()
+{
+ bool ndjson=server.arg("format")=="ndjson";
+ uint32_t from=server.hasArg("from")?strtoul(server.arg("from").c_str(),NULL,10):0;
+ uint32_t to=server.hasArg("to")?strtoul(server.arg("to").c_str(),NULL,10):UINT32_MAX;
+
+ server.sendHeader("Content-Disposition",ndjson?"attachment; filename=\"history.ndjson\"":"attachment; filename=\"history.csv\"");
+ respStreamBegin(ndjson?"application/x-ndjson":"text/csv");
+
+ if(!ndjson)
+ {
+  respAdd("t");
+  for(int c=0;c<HC_COUNT;c++) respAdd(",%s",HIST_CHANNEL_NAMES[c]);
+  respAdd("\n");
+ }
+
+ HistReader r;
+ char b[12];
+
+ histSeek(r,from);
+
+ while(histNext(r))
  {
-  target=PUMP_OFF_TIME;
+  if(r.t<from) continue;
+  if(r.t>to) break;
 
-  if(now-pumpTimer>=target)
+  if(ndjson) respAdd("{\"t\":%lu",(unsigned long)r.t);
+  else respAdd("%lu",(unsigned long)r.t);
+
+  for(int c=0;c<HC_COUNT;c++)
   {
-   pumpState=true;
-   pumpTimer=now;
+   // 빈 값: CSV 는 빈 칸, NDJSON 은 null
+   if(r.v[c]==SENSOR_NA) strcpy(b,ndjson?"null":"");
+   else fmtFixed(b,r.v[c],HIST_SCALE[c],HIST_SCALE[c]);
 
-   digitalWrite(RELAY_PUMP,RELAY_ON);
-   appendLog("[PUMP] ON");
+   if(ndjson) respAdd(",\"%s\":%s",HIST_CHANNEL_NAMES[c],b);
+   else respAdd(",%s",b);
   }
+
+  respAdd(ndjson?"}\n":"\n");
+  respStreamFlush();
  }
+
+ respStreamEnd();
 }
 
-// ---------------- LED ----------------
-void handleLED()
+// ---------------- BURST API ----------------
+// /api/burst?seconds=10&res=9 : 캡처 시작 (res 9~12), 인자 없으면 상태만
+void handleBurstApi()
 {
- int cur=rtcNow.hour()*60+rtcNow.minute();
+ if(server.hasArg("seconds"))
+ {
+  long sec=server.arg("seconds").toInt();
+  long res=server.hasArg("res")?server.arg("res").toInt():9;
 
- int on=5*60+30;
- int off=22*60+30;
+  if(res<9 || res>12) res=9;
+  if(sec<1) sec=1;
+  if(sec>burstMaxSec(res)) sec=burstMaxSec(res);
+
+  if(!burstStart(sec,res))
+  {
+   server.send(409,"application/json","{\"error\":\"burst already running\"}");
+   return;
+  }
+ }
+
+ int n[BC_COUNT]={0};
+ for(int i=0;i<burstCount;i++) n[burstBuf[i].channel]++;
+
+ respBegin();
+ respAdd("{\"state\":\"%s\",\"res\":%u,\"maxSec\":%u,\"durationMs\":%lu,\"elapsedMs\":%lu,\"samples\":%d,\"capacity\":%d,"
+ "\"overflow\":%s,\"maxConvMs\":%u,\"water\":%d,\"air\":%d,\"hum\":%d}",
+ BURST_STATE_NAMES[burstState],burstResolution,burstMaxSec(burstResolution),burstDurationMs,
+ burstState==BS_RUNNING?millis()-burstStartMs:(burstCount?(unsigned long)burstBuf[burstCount-1].ms:0UL),
+ burstCount,BURST_SAMPLES,burstOverflow?"true":"false",burstMaxConvMs,n[BC_WATER],n[BC_AIR],n[BC_HUM]);
+ respSend("application/json");
+}
+
+// /api/burst/data : ms,sensor,value CSV (진행 중이면 지금까지)
+void handleBurstData()
+{
+ char b[12];
 
- bool newState=(cur>=on && cur<off);
+ server.sendHeader("Content-Disposition","attachment; filename=\"burst.csv\"");
+ respStreamBegin("text/csv");
+ respAdd("ms,sensor,value\n");
 
- if(newState!=ledState)
+ for(int i=0;i<burstCount;i++)
  {
-  ledState=newState;
-  digitalWrite(RELAY_LED,ledState?RELAY_ON:RELAY_OFF);
-  logRelay("LED",ledState);
+  const BurstSample &s=burstBuf[i];
+
+  if(s.value==SENSOR_NA) b[0]=0;
+  else fmtFixed(b,s.value,BURST_SCALE[s.channel],BURST_SCALE[s.channel]);
+
+  respAdd("%lu,%s,%s\n",(unsigned long)s.ms,BURST_CHANNEL_NAMES[s.channel],b);
+  respStreamFlush();
  }
+
+ respStreamEnd();
 }
 
-// ---------------- 수온 ----------------
-void handleWaterControl(float w)
+// ---------------- ALARM API ----------------
+// /api/alarms?since=seq : 규칙 상태 + seq 이후 이벤트
+void handleAlarms()
 {
- bool newHeater=heaterState;
- bool newFan=fanState;
+ uint32_t since=server.hasArg("since")?server.arg("since").toInt():0;
 
- if(!heaterState && w<=HEATER_ON)
+ respBegin();
+ respAdd("{\"seq\":%lu,\"rules\":[",(unsigned long)alarmSeq);
+
+ char vb[16];
+
+ for(int i=0;i<ALARM_COUNT;i++)
  {
-  newHeater=true;
-  newFan=false;
+  const AlarmState &st=alarmStates[i];
+  alarmFormat(vb,i,st.value);
+  respAdd("%s{\"name\":\"%s\",\"active\":%s,\"latched\":%s,\"value\":%s}",i?",":"",
+  ALARM_RULES[i].name,st.active?"true":"false",st.latched?"true":"false",vb);
  }
- else if(heaterState && w>=HEATER_OFF)
- newHeater=false;
 
- if(!fanState && w>=FAN_ON)
+ respAdd("],\"events\":[");
+
+ uint32_t first=alarmSeq>ALARM_EVENTS?alarmSeq-ALARM_EVENTS+1:1;
+ if(since+1>first) first=since+1;
+
+ for(uint32_t q=first;q<=alarmSeq;q++)
  {
-  newFan=true;
-  newHeater=false;
+  const AlarmEvent &e=alarmEvents[(q-1)%ALARM_EVENTS];
+  alarmFormat(vb,e.rule,e.value);
+  respAdd("%s{\"seq\":%lu,\"t\":%lu,\"name\":\"%s\",\"type\":\"%s\",\"value\":%s}",
+  q==first?"":",",(unsigned long)e.seq,(unsigned long)e.epoch,ALARM_RULES[e.rule].name,
+  ALARM_EVENT_NAMES[e.type],vb);
  }
- else if(fanState && w<=FAN_OFF)
- newFan=false;
 
- if(newHeater!=heaterState)
+ respAdd("]}");
+ respSend("application/json");
+}
+
+// /api/alarms/ack?name=WATER_STALE | all
+void handleAlarmAck()
+{
+ String name=server.arg("name");
+
+ for(int i=0;i<ALARM_COUNT;i++)
+ {
+  if(!alarmStates[i].latched) continue;
+  if(name!="all" && name!=ALARM_RULES[i].name) continue;
+
+  alarmStates[i].latched=false;
+  alarmEvent(i,AE_ACK,alarmStates[i].value);
+ }
+
+ handleAlarms();
+}
+
+// ---------------- LOG MASK API ----------------
+// /api/log/mask?set=RELAY,PUMP | all | production
+void handleLogMask()
+{
+ if(server.hasArg("set"))
  {
-  heaterState=newHeater;
-  digitalWrite(RELAY_HEATER,heaterState?RELAY_ON:RELAY_OFF);
-  logRelay("HEATER",heaterState);
+  String v=server.arg("set");
+
+  if(v=="all") logMask=LOG_MASK_ALL;
+  else if(v=="production") logMask=LOG_MASK_PRODUCTION;
+  else
+  {
+   uint8_t m=0;
+   for(int i=0;i<CAT_COUNT;i++)
+   if(v.indexOf(LOG_CAT_NAMES[i])>=0) m|=1<<i;
+   logMask=m;
+  }
  }
 
- if(newFan!=fanState)
+ respBegin();
+ respAdd("{\"levelMin\":%d,\"suppressed\":%lu,\"enabled\":[",LOG_LEVEL_MIN,logSuppressed);
+
+ bool first=true;
+ for(int i=0;i<CAT_COUNT;i++)
  {
-  fanState=newFan;
-  digitalWrite(RELAY_FAN,fanState?RELAY_ON:RELAY_OFF);
-  logRelay("FAN",fanState);
+  if(!(logMask&(1<<i))) continue;
+  respAdd("%s\"%s\"",first?"":",",LOG_CAT_NAMES[i]);
+  first=false;
  }
+
+ respAdd("]}");
+ respSend("application/json");
 }
 
-// ---------------- 센서 ----------------
-void handleSensorLog()
+// ---------------- TELEMETRY API ----------------
+// /api/telemetry?interval=ms  (0=끔, 최소 100ms)
+void handleTelemetryApi()
 {
- if(millis()-lastSensorLog<5000) return;
-
- lastSensorLog=millis();
+ if(server.hasArg("interval"))
+ {
+  long v=server.arg("interval").toInt();
 
- float h=dht.readHumidity();
- float t=dht.readTemperature();
+  telemetryIntervalMs=(v<=0)?0:(v<100?100:v);
+  prefs.putUInt("udp_ms",telemetryIntervalMs);
+ }
 
- waterSensor.requestTemperatures();
- float w=waterSensor.getTempCByIndex(0);
+ respBegin();
+ respAdd("{\"interval\":%lu,\"port\":%u,\"version\":%u,\"seq\":%lu}",
+ telemetryIntervalMs,TELEMETRY_PORT,TELEMETRY_VERSION,(unsigned long)telemetrySeq);
+ respSend("application/json");
+}
 
- lastAirTemp=t;
- lastHum=h;
- lastWaterTemp=w;
+// ---------------- HEAP API ----------------
+// 스택 값, 태스크가 없으면 null
+void respStack(uint16_t v)
+{
+ if(v==STACK_NA) respAdd("null");
+ else respAdd("%u",(unsigned)v);
+}
 
- char timebuf[32];
- char line[80];
+// /api/heap?n=60 : 현재값 + 최근 n개 샘플 (오래된 것부터)
+// history 항목: [ms, free, largest, loop 스택, frag, serialTx 스택, mqttConnect 스택]
+void handleHeap()
+{
+ int n=server.hasArg("n")?server.arg("n").toInt():60;
+ if(n<0) n=0;
+ if(n>heapCount) n=heapCount;
+ if(n>80) n=80;
 
- getNow(timebuf);
+ respStreamBegin("application/json");
 
- snprintf(line,80,"[%s] SENSOR",timebuf);
- appendLog(line);
+ respAdd("{\"free\":%lu,\"minFree\":%lu,\"largest\":%lu,\"minLargest\":%lu,\"stackFree\":%u,\"alert\":%s,",
+ (unsigned long)ESP.getFreeHeap(),(unsigned long)ESP.getMinFreeHeap(),
+ (unsigned long)ESP.getMaxAllocHeap(),(unsigned long)heapMinLargest,
+ (unsigned)stackMinFree[STK_LOOP],heapFragAlert?"true":"false");
 
- snprintf(line,80,"[DHT11] Temp=%.1fC Hum=%.1f%%",t,h);
- appendLog(line);
+ respAdd("\"stackMinFree\":{");
+ for(int t=0;t<STK_COUNT;t++)
+ {
+  respAdd("%s\"%s\":",t?",":"",STACK_TASK_NAMES[t]);
+  respStack(stackMinFree[t]);
+ }
 
- snprintf(line,80,"[DS18B20] Water=%.2fC",w);
- appendLog(line);
+ respAdd("},\"cols\":[\"ms\",\"free\",\"largest\",\"stack_loop\",\"frag\",\"stack_serialTx\",\"stack_mqttConnect\"],\"history\":[");
 
- if(w==DEVICE_DISCONNECTED_C || w<-40 || w>80)
+ for(int i=0;i<n;i++)
  {
-  digitalWrite(RELAY_HEATER,RELAY_OFF);
-  digitalWrite(RELAY_FAN,RELAY_OFF);
- 
-  heaterState=false;
-  fanState=false;
- 
-  appendLog("[ERROR] WATER SENSOR FAIL");
- 
-  return;
+  const HeapSample &h=heapHistory[(heapHead-n+i+HEAP_HISTORY)%HEAP_HISTORY];
+  respAdd("%s[%lu,%lu,%lu,%u,%u,",i?",":"",(unsigned long)h.ms,
+  (unsigned long)h.freeHeap,(unsigned long)h.largest,(unsigned)h.stackFree[STK_LOOP],(unsigned)h.frag);
+  respStack(h.stackFree[STK_SERIAL]);
+  respAdd(",");
+  respStack(h.stackFree[STK_MQTT]);
+  respAdd("]");
+  respStreamFlush();
  }
- 
- handleWaterControl(w);
+
+ respAdd("]}");
+
+ respStreamEnd();
 }
 
-// ---------------- 상태 ----------------
-void handleStatusLine()
+// ---------------- PERF API ----------------
+#if PERF_ENABLE
+// 핸들러마다 bin 이 최대 33개라 4KB 한 번에 담기지 않을 수 있으므로 나눠 보낸다
+void handlePerf()
 {
- if(millis()-lastStatusLog<5000) return;
+ respStreamBegin("application/json");
 
- lastStatusLog=millis();
+ respAdd("{\"cpuMHz\":%u,\"loopMaxJitterUs\":%.1f,\"handlers\":[",
+ (unsigned)ESP.getCpuFreqMHz(),perfUs(perfLoopMaxJitter));
 
- unsigned long r=getPumpRemainMs();
- unsigned long sec=r/1000;
- unsigned long min=sec/60;
- sec%=60;
+ for(int i=0;i<PERF_COUNT;i++)
+ {
+  const PerfStat &p=perfStats[i];
 
- char t[32];
- char line[200];
+  respAdd("%s{\"name\":\"%s\",\"count\":%lu,\"meanUs\":%.1f,\"maxUs\":%.1f,\"maxJitterUs\":%.1f,\"hist\":[",
+  i?",":"",PERF_NAMES[i],(unsigned long)p.count,
+  p.count?perfUs(p.sum/p.count):0.0f,perfUs(p.max),perfUs(p.maxJitter));
+
+  // [상한 us, 횟수] 쌍, 비어있는 bin 생략
+  bool first=true;
+  for(int b=0;b<PERF_BINS;b++)
+  {
+   if(!p.hist[b]) continue;
+   respAdd("%s[%.2f,%lu]",first?"":",",perfUs(1ULL<<b),(unsigned long)p.hist[b]);
+   first=false;
+   respStreamFlush();
+  }
 
- getNow(t);
+  respAdd("]}");
+  respStreamFlush();
+ }
 
- snprintf(line,200,
- "[%s] T=%.1fC H=%.1f%% W=%.2fC PUMP_REM=%02lu:%02lu HEATER=%s FAN=%s LED=%s PUMP=%s",
- t,lastAirTemp,lastHum,lastWaterTemp,
- min,sec,
- heaterState?"ON":"OFF",
- fanState?"ON":"OFF",
- ledState?"ON":"OFF",
- pumpState?"ON":"OFF");
+ respAdd("],\"worst\":[");
 
- appendLog(line);
+ for(int i=0;i<PERF_WORST_N && perfWorst[i].cycles;i++)
+ {
+  respAdd("%s{\"name\":\"%s\",\"us\":%.1f,\"ms\":%lu}",
+  i?",":"",PERF_NAMES[perfWorst[i].id],perfUs(perfWorst[i].cycles),(unsigned long)perfWorst[i].ms);
+  respStreamFlush();
+ }
+
+ respAdd("]}");
+
+ respStreamEnd();
 }
 
-// ---------------- API ----------------
-void handleLogs()
+void printPerf()
 {
- server.send(200,"text/plain",logBuffer);
+ serialPrintf("---- PERF (loop jitter max %.1f us) ----",perfUs(perfLoopMaxJitter));
+ serialPrintf("%-18s %8s %10s %10s %10s","handler","count","mean_us","max_us","jitter_us");
+
+ for(int i=0;i<PERF_COUNT;i++)
+ {
+  const PerfStat &p=perfStats[i];
+  serialPrintf("%-18s %8lu %10.1f %10.1f %10.1f",PERF_NAMES[i],(unsigned long)p.count,
+  p.count?perfUs(p.sum/p.count):0.0f,perfUs(p.max),perfUs(p.maxJitter));
+ }
+
+ for(int i=0;i<PERF_WORST_N && perfWorst[i].cycles;i++)
+ serialPrintf("worst#%d %-18s %10.1f us @%lu ms",i+1,PERF_NAMES[perfWorst[i].id],
+ perfUs(perfWorst[i].cycles),(unsigned long)perfWorst[i].ms);
 }
+#endif
 
-// ----------- RTC TIME API -----------
-void handleTime()
+// ---------------- 시리얼 명령 ----------------
+// p: 성능 통계 출력, r: 성능 통계 초기화
+void handleSerialCommand()
 {
- char buf[32];
- getNow(buf);
- server.send(200,"text/plain",buf);
+ if(!Serial.available()) return;
+
+ int c=Serial.read();
+
+#if PERF_ENABLE
+ if(c=='p') printPerf();
+ else if(c=='r') perfReset();
+#else
+ (void)c;
+#endif
 }
 
 // ---------------- HTML ----------------
@@ -395,7 +4022,13 @@ ESP32 Farm Monitor
 </div>
 
 <div class="card">
-<h3>실시간 로그</h3>
+<h3>실시간 로그
+<select id="tag" onchange="load()">
+<option value="">전체</option>
+<option>HEATER</option><option>FAN</option><option>LED</option><option>PUMP</option>
+<option>ALARM</option><option>SENSOR</option><option>STATUS</option><option>MQTT</option><option>ERROR</option>
+</select>
+</h3>
 <div class="log" id="log"></div>
 </div>
 
@@ -405,33 +4038,21 @@ ESP32 Farm Monitor
 
 async function load(){
 
- const txt = await fetch('/api/logs').then(r=>r.text());
+ const tag = document.getElementById("tag").value;
+ const txt = await fetch(tag ? '/api/logs/query?tag='+tag+'&limit=64' : '/api/logs').then(r=>r.text());
 
  const logEl = document.getElementById("log");
 
  logEl.textContent = txt;
  logEl.scrollTop = logEl.scrollHeight;
 
- const lines = txt.trim().split("\n");
-
- if(lines.length==0) return;
-
- let statusLine="";
-
- for(let i=lines.length-1;i>=0;i--)
- {
-  if(lines[i].includes("PUMP_REM="))
-  {
-   statusLine = lines[i];
-   break;
-  }
- }
+ const statusLine = (await fetch('/api/logs/query?tag=STATUS&limit=1').then(r=>r.text())).trim();
 
  if(statusLine==="") return;
 
- const t=statusLine.match(/T=([0-9.]+)/);
- const h=statusLine.match(/H=([0-9.]+)/);
- const w=statusLine.match(/W=([0-9.]+)/);
+ const t=statusLine.match(/T=(-?[0-9.]+|NA)/);
+ const h=statusLine.match(/H=(-?[0-9.]+|NA)/);
+ const w=statusLine.match(/W=(-?[0-9.]+|NA)/);
  const p=statusLine.match(/PUMP_REM=([0-9:]+)/);
 
  const heater=statusLine.match(/HEATER=(ON|OFF)/);
@@ -479,50 +4100,133 @@ void setup()
 {
  Serial.begin(115200);
 
- pinMode(RELAY_HEATER,OUTPUT);
- pinMode(RELAY_FAN,OUTPUT);
- pinMode(RELAY_LED,OUTPUT);
- pinMode(RELAY_PUMP,OUTPUT);
+ xTaskCreatePinnedToCore(serialDrainTask,"serialTx",2048,NULL,tskIDLE_PRIORITY+1,&serialTaskHandle,0);
 
- digitalWrite(RELAY_HEATER,RELAY_OFF);
- digitalWrite(RELAY_FAN,RELAY_OFF);
- digitalWrite(RELAY_LED,RELAY_OFF);
- digitalWrite(RELAY_PUMP,RELAY_OFF);
+ HeaterRelay::init();
+ FanRelay::init();
+ LedRelay::init();
+ PumpRelay::init();
+
+ relayBank.stage<HeaterRelay>(false);
+ relayBank.stage<FanRelay>(false);
+ relayBank.stage<LedRelay>(false);
+ relayBank.stage<PumpRelay>(false);
+ relayBank.flush();
 //  pumpState=true;
-//  digitalWrite(RELAY_PUMP,RELAY_ON);
+//  relayBank.stage<PumpRelay>(true);
 
  Wire.begin(21,22);
 
+ prefs.begin("farm");
+ energyLoad();
+ wearLoad();
+ tuneLoad();
+ telemetryIntervalMs=prefs.getUInt("udp_ms",0);
+
  rtc.begin();
+ rtcNow=rtc.now();
+ relayHistoryBegin();
+
  dht.begin();
  waterSensor.begin();
 
- WiFi.mode(WIFI_AP);
+ WiFi.mode(sta_ssid[0]?WIFI_AP_STA:WIFI_AP);
  WiFi.softAP(ap_ssid,ap_pass);
 
+ if(sta_ssid[0])
+ {
+  WiFi.begin(sta_ssid,sta_pass);
+  WiFi.setAutoReconnect(true);
+ }
+
  server.on("/",[](){
   server.send_P(200,"text/html",INDEX_HTML);
  });
 
  server.on("/api/logs",handleLogs);
+ server.on("/api/logs/query",handleLogQuery);
  server.on("/api/time",handleTime);
+ server.on("/metrics",handleMetrics);
+ server.on("/api/heap",handleHeap);
+ server.on("/api/trace",handleTrace);
+ server.on("/api/log/mask",handleLogMask);
+ server.on("/api/energy",handleEnergyApi);
+ server.on("/api/relays/at",handleRelayAt);
+ server.on("/api/relays/events",handleRelayEvents);
+ server.on("/api/relays/wear",handleRelayWear);
+ server.on("/api/alarms",handleAlarms);
+ server.on("/api/stats",handleStats);
+ server.on("/api/tune",handleTuneApi);
+ server.on("/api/history",handleHistory);
+ server.on("/api/export",handleExport);
+ server.on("/api/burst",handleBurstApi);
+ server.on("/api/burst/data",handleBurstData);
+ server.on("/api/telemetry",handleTelemetryApi);
+ server.on("/api/alarms/ack",handleAlarmAck);
+#if PERF_ENABLE
+ server.on("/api/perf",handlePerf);
+#endif
 
  server.begin();
 
- appendLog("System Start");
+ LOG_I(CAT_SYSTEM,"System Start");
 
- pumpTimer=millis();
+ startPumpTimer();
 }
 
 // ---------------- LOOP ----------------
 void loop()
 {
+ unsigned long loopStart=micros();
+
+ PERF_BEGIN(PERF_LOOP);
+#if PERF_ENABLE
+ perfLoopStart(perfT_PERF_LOOP);
+#endif
+
+ PERF_BEGIN(PERF_CLIENT);
  server.handleClient();
+ PERF_END(PERF_CLIENT);
 
+ PERF_BEGIN(PERF_RTC);
  rtcNow=rtc.now();
+ PERF_END(PERF_RTC);
 
+ PERF_BEGIN(PERF_PUMP);
  handlePump();
+ PERF_END(PERF_PUMP);
+
+ PERF_BEGIN(PERF_LED);
  handleLED();
- handleSensorLog();
+ PERF_END(PERF_LED);
+
+ handleBurst();
+
+ PERF_BEGIN(PERF_SENSOR);
+ acquireSensors();
+ controlSensors();
+ PERF_END(PERF_SENSOR);
+
+ logDrain();
+
+ PERF_BEGIN(PERF_STATUS);
  handleStatusLine();
+ PERF_END(PERF_STATUS);
+
+ relayBank.flush();
+
+ PERF_BEGIN(PERF_MQTT);
+ handleMqtt();
+ PERF_END(PERF_MQTT);
+
+ handleTelemetry();
+
+ handleEnergy();
+ handleRelayHistory();
+ handleHeapSample();
+ handleSerialCommand();
+
+ PERF_END(PERF_LOOP);
+
+ observeLoop(micros()-loopStart);
 }
@@ -0,0 +1,844 @@
+// 농장 장치 수집기 (호스트)
+//
+// 여러 대의 fish_plant 장치를 단일 스레드 epoll 루프로 동시에 폴링해 상태 한줄을 모으고,
+// 열(column) 단위 시계열 파일로 저장한다.
+//  - 04/03 형식: /api/logs 의 "[시각] T=..C H=..% W=..C PUMP_REM=mm:ss HEATER=.. FAN=.. LED=.. PUMP=.."
+//    줄 중 마지막으로 받은 시각 이후의 줄만 새 샘플로 넣는다 (폴링 사이의 줄도 빠지지 않음)
+//  - host:port/status 로 지정한 장치는 03 의 /api/status(JSON) 한 건을 샘플로 넣는다
+//  - /api/time 은 --time-every 주기마다 받아 장치 RTC 오차(skew)를 기록한다
+// 호스트마다 연결/HTTP 실패 시 지수 backoff(최대 --max-backoff) 후 다시 시도한다.
+// 응답은 호스트별로 미리 잡아 둔 버퍼에 받고 그 자리에서 파싱하므로 줄마다 할당이 없다.
+//
+// 빌드: g++ -O2 -std=gnu++17 tools/fleet_collector.cpp -o fleet_collector
+// 실행: ./fleet_collector [옵션] host:port[+N][/status] ... | --hosts file
+//  --out fleet.col      출력 파일 (기본 fleet.col, 이어 쓰기)
+//  --interval 5000      호스트별 폴링 주기(ms)
+//  --duration 0         N 초 뒤 종료 (0=Ctrl-C 까지)
+//  --timeout 3000       연결+응답 제한(ms)
+//  --max-backoff 60000  backoff 상한(ms)
+//  --max-conn 256       동시 연결 상한
+//  --time-every 10      /api/time 주기(폴링 횟수)
+// 읽기: ./fleet_collector --dump fleet.col [--csv]
+//
+// 파일 형식 (리틀엔디언)
+//  블록 = "FCB1" u32 rows, u16 hostCount, hostCount x (u16 len, 이름)
+//         host u16[rows] | ts u32[rows] | air i16[rows] | hum i16[rows] | water i16[rows]
+//         | pump_rem u16[rows] | relays u8[rows]
+//  ts 는 장치 RTC 시각(unixtime, 장치 로컬 시간), 값은 0.01 단위, -32768 은 측정 실패.
+//  relays 비트: 0 heater, 1 fan, 2 led, 3 pump
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const int16_t NA=INT16_MIN;
+static const size_t RESP_CAP=16384;     // 장치 logBuffer(12000) + 헤더
+static const uint32_t BLOCK_ROWS=4096;
+
+enum HostState{HS_IDLE,HS_CONNECTING,HS_SENDING,HS_READING};
+enum Request{RQ_LOGS,RQ_STATUS,RQ_TIME};
+
+static const char* const REQUEST_PATHS[]={"/api/logs","/api/status","/api/time"};
+
+struct Host
+{
+ char name[64];
+ sockaddr_in addr;
+ bool statusApi;         // 03 형식: /api/status
+
+ int fd=-1;
+ uint8_t state=HS_IDLE;
+ uint8_t req=RQ_LOGS;
+ char* buf=nullptr;      // RESP_CAP+1
+ size_t len=0;
+ size_t reqSent=0;
+ char reqText[128];
+ size_t reqLen=0;
+
+ uint64_t nextMs=0;
+ uint64_t deadlineMs=0;
+ uint32_t fails=0;
+ uint32_t polls=0;
+
+ uint32_t lastTs=0;      // 마지막으로 받은 샘플 시각
+ int32_t skew=0;
+ bool skewKnown=false;
+
+ unsigned long ok=0;
+ unsigned long errors=0;
+ unsigned long samples=0;
+};
+
+// ---------------- 열 저장 ----------------
+struct Columns
+{
+ std::vector<uint16_t> host;
+ std::vector<uint32_t> ts;
+ std::vector<int16_t> air;
+ std::vector<int16_t> hum;
+ std::vector<int16_t> water;
+ std::vector<uint16_t> pumpRem;
+ std::vector<uint8_t> relays;
+
+ void reserve(size_t n)
+ {
+  host.reserve(n);
+  ts.reserve(n);
+  air.reserve(n);
+  hum.reserve(n);
+  water.reserve(n);
+  pumpRem.reserve(n);
+  relays.reserve(n);
+ }
+
+ size_t size() const{return ts.size();}
+
+ void clear()
+ {
+  host.clear();
+  ts.clear();
+  air.clear();
+  hum.clear();
+  water.clear();
+  pumpRem.clear();
+  relays.clear();
+ }
+};
+
+static std::vector<Host> hosts;
+static Columns cols;
+static FILE* outFile=nullptr;
+static unsigned long rowsWritten=0;
+
+template<typename T>
+static void writeColumn(const std::vector<T>& v)
+{
+ fwrite(v.data(),sizeof(T),v.size(),outFile);
+}
+
+static void flushBlock()
+{
+ if(!cols.size()) return;
+
+ uint32_t rows=cols.size();
+ uint16_t n=hosts.size();
+
+ fwrite("FCB1",1,4,outFile);
+ fwrite(&rows,4,1,outFile);
+ fwrite(&n,2,1,outFile);
+
+ for(const Host& h:hosts)
+ {
+  uint16_t len=strlen(h.name);
+  fwrite(&len,2,1,outFile);
+  fwrite(h.name,1,len,outFile);
+ }
+
+ writeColumn(cols.host);
+ writeColumn(cols.ts);
+ writeColumn(cols.air);
+ writeColumn(cols.hum);
+ writeColumn(cols.water);
+ writeColumn(cols.pumpRem);
+ writeColumn(cols.relays);
+ fflush(outFile);
+
+ rowsWritten+=rows;
+ cols.clear();
+}
+
+static void addRow(uint16_t host,uint32_t ts,int16_t air,int16_t hum,int16_t water,uint16_t rem,uint8_t relays)
+{
+ cols.host.push_back(host);
+ cols.ts.push_back(ts);
+ cols.air.push_back(air);
+ cols.hum.push_back(hum);
+ cols.water.push_back(water);
+ cols.pumpRem.push_back(rem);
+ cols.relays.push_back(relays);
+
+ if(cols.size()>=BLOCK_ROWS) flushBlock();
+}
+
+// ---------------- 파싱 (할당 없음) ----------------
+static uint64_t nowMs()
+{
+ timespec ts;
+ clock_gettime(CLOCK_MONOTONIC,&ts);
+ return ts.tv_sec*1000ULL+ts.tv_nsec/1000000;
+}
+
+static int digits(const char* p,int n)
+{
+ int v=0;
+ for(int i=0;i<n;i++)
+ {
+  if(p[i]<'0' || p[i]>'9') return -1;
+  v=v*10+(p[i]-'0');
+ }
+ return v;
+}
+
+// 1970-01-01 부터의 일수 (proleptic Gregorian)
+static int64_t daysFromCivil(int y,unsigned m,unsigned d)
+{
+ y-=m<=2;
+ int64_t era=(y>=0?y:y-399)/400;
+ unsigned yoe=(unsigned)(y-era*400);
+ unsigned doy=(153*(m>2?m-3:m+9)+2)/5+d-1;
+ unsigned doe=yoe*365+yoe/4-yoe/100+doy;
+ return era*146097+(int64_t)doe-719468;
+}
+
+// "YYYY-MM-DD HH:MM:SS" → unixtime, 실패 시 0
+static uint32_t parseTime(const char* p)
+{
+ int y=digits(p,4),mo=digits(p+5,2),d=digits(p+8,2);
+ int h=digits(p+11,2),mi=digits(p+14,2),s=digits(p+17,2);
+
+ if(y<0 || mo<1 || d<1 || h<0 || mi<0 || s<0 || p[4]!='-' || p[10]!=' ') return 0;
+
+ return (uint32_t)(daysFromCivil(y,mo,d)*86400+h*3600+mi*60+s);
+}
+
+// "12.34" / "nan" / "NA" / "null" → 0.01 단위
+static int16_t parseCenti(const char* p,const char** end)
+{
+ char* e;
+ double v=strtod(p,&e);
+
+ if(e==p)
+ {
+  while(*p && *p!=' ' && *p!=',' && *p!='}') p++;
+  *end=p;
+  return NA;
+ }
+
+ *end=e;
+ if(isnan(v) || v<-327 || v>327) return NA;
+ return (int16_t)lround(v*100);
+}
+
+static const char* after(const char* p,const char* end,const char* key)
+{
+ size_t k=strlen(key);
+ const char* f=(const char*)memmem(p,end-p,key,k);
+ return f?f+k:nullptr;
+}
+
+static bool onAt(const char* p,const char* end,const char* key)
+{
+ const char* v=after(p,end,key);
+ return v && v[0]=='O' && v[1]=='N';
+}
+
+// 상태 한줄 하나. 새 샘플이면 넣고 true
+static bool parseStatusLine(Host& h,uint16_t id,const char* p,const char* end)
+{
+ if(end-p<40 || p[0]!='[' || p[20]!=']') return false;
+
+ const char* t=after(p,end,"] T=");
+ if(!t) return false;
+
+ uint32_t ts=parseTime(p+1);
+ if(!ts || ts<=h.lastTs) return false;
+
+ const char* q;
+ int16_t air=parseCenti(t,&q);
+
+ const char* hv=after(q,end,"H=");
+ const char* wv=hv?after(hv,end,"W="):nullptr;
+ const char* rv=wv?after(wv,end,"PUMP_REM="):nullptr;
+ if(!rv) return false;
+
+ int16_t hum=parseCenti(hv,&q);
+ int16_t water=parseCenti(wv,&q);
+ int mm=digits(rv,2),ss=digits(rv+3,2);
+
+ uint8_t relays=(onAt(rv,end,"HEATER=")<<0)|(onAt(rv,end,"FAN=")<<1)|(onAt(rv,end,"LED=")<<2)|(onAt(rv,end," PUMP=")<<3);
+
+ addRow(id,ts,air,hum,water,mm<0||ss<0?0:mm*60+ss,relays);
+ h.lastTs=ts;
+ return true;
+}
+
+static void parseLogs(Host& h,uint16_t id,char* body,char* end)
+{
+ for(char* p=body;p<end;)
+ {
+  char* nl=(char*)memchr(p,'\n',end-p);
+  char* le=nl?nl:end;
+
+  if(parseStatusLine(h,id,p,le)) h.samples++;
+
+  p=le+1;
+ }
+}
+
+static int16_t jsonCenti(const char* body,const char* end,const char* key)
+{
+ const char* v=after(body,end,key);
+ if(!v) return NA;
+ const char* q;
+ return parseCenti(v,&q);
+}
+
+static void parseStatusJson(Host& h,uint16_t id,const char* body,const char* end)
+{
+ const char* now=after(body,end,"\"now\":\"");
+ if(!now || end-now<19) return;
+
+ uint32_t ts=parseTime(now);
+ if(!ts || ts<=h.lastTs) return;
+
+ const char* rem=after(body,end,"\"pumpRemain\":\"");
+ int mm=rem?digits(rem,2):-1,ss=rem?digits(rem+3,2):-1;
+
+ auto flag=[&](const char* key)
+ {
+  const char* v=after(body,end,key);
+  return v && v[0]=='t';
+ };
+
+ uint8_t relays=(flag("\"heater\":")<<0)|(flag("\"fan\":")<<1)|(flag("\"led\":")<<2)|(flag("\"pump\":")<<3);
+
+ addRow(id,ts,jsonCenti(body,end,"\"airTemp\":"),jsonCenti(body,end,"\"hum\":"),jsonCenti(body,end,"\"waterTemp\":"),
+ mm<0||ss<0?0:mm*60+ss,relays);
+
+ h.lastTs=ts;
+ h.samples++;
+}
+
+// 장치 RTC 는 현지 시각이므로 수집기의 현지 시각과 비교한다
+static int32_t localEpoch()
+{
+ time_t t=time(nullptr);
+ tm v;
+ localtime_r(&t,&v);
+ return (int32_t)(t+v.tm_gmtoff);
+}
+
+// ---------------- 호스트 상태 기계 ----------------
+static int epfd=-1;
+static int active=0;
+static uint32_t intervalMs=5000;
+static uint32_t timeoutMs=3000;
+static uint32_t maxBackoffMs=60000;
+static uint32_t timeEvery=10;
+
+static void finish(Host& h,bool ok)
+{
+ if(h.fd>=0)
+ {
+  epoll_ctl(epfd,EPOLL_CTL_DEL,h.fd,nullptr);
+  close(h.fd);
+  h.fd=-1;
+  active--;
+ }
+
+ h.state=HS_IDLE;
+
+ uint64_t now=nowMs();
+
+ if(ok)
+ {
+  h.ok++;
+  h.fails=0;
+
+  // 같은 폴링 주기 안에서 /api/time 을 이어서 받는다
+  if(h.req!=RQ_TIME && timeEvery && h.polls%timeEvery==1)
+  {
+   h.req=RQ_TIME;
+   h.nextMs=now;
+   return;
+  }
+
+  h.nextMs=now+intervalMs;
+ }
+ else
+ {
+  h.errors++;
+  h.fails++;
+
+  // 지수 backoff + 0~25% 흔들기 (동시에 몰리는 재시도 분산)
+  uint64_t b=(uint64_t)intervalMs<<(h.fails<6?h.fails:6);
+  if(b>maxBackoffMs) b=maxBackoffMs;
+  h.nextMs=now+b+rand()%(b/4+1);
+ }
+
+ h.req=h.statusApi?RQ_STATUS:RQ_LOGS;
+}
+
+static void handleResponse(Host& h,uint16_t id)
+{
+ h.buf[h.len]=0;
+
+ char* hdrEnd=(char*)memmem(h.buf,h.len,"\r\n\r\n",4);
+ if(!hdrEnd || h.len<12 || memcmp(h.buf,"HTTP/1.",7))
+ {
+  finish(h,false);
+  return;
+ }
+
+ int code=digits(h.buf+9,3);
+ if(code!=200)
+ {
+  finish(h,false);
+  return;
+ }
+
+ char* body=hdrEnd+4;
+ char* end=h.buf+h.len;
+
+ if(h.req==RQ_LOGS) parseLogs(h,id,body,end);
+ else if(h.req==RQ_STATUS) parseStatusJson(h,id,body,end);
+ else
+ {
+  uint32_t dev=end-body>=19?parseTime(body):0;
+  if(dev)
+  {
+   h.skew=(int32_t)dev-localEpoch();
+   h.skewKnown=true;
+  }
+ }
+
+ finish(h,true);
+}
+
+static void startPoll(Host& h,uint16_t id)
+{
+ h.fd=socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0);
+ if(h.fd<0)
+ {
+  h.nextMs=nowMs()+1000;   // fd 부족: 잠시 뒤
+  return;
+ }
+
+ active++;
+
+ if(h.req!=RQ_TIME) h.polls++;
+
+ h.len=0;
+ h.reqSent=0;
+ h.reqLen=snprintf(h.reqText,sizeof(h.reqText),"GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n",
+ REQUEST_PATHS[h.req],h.name);
+ h.deadlineMs=nowMs()+timeoutMs;
+
+ int r=connect(h.fd,(sockaddr*)&h.addr,sizeof(h.addr));
+
+ if(r<0 && errno!=EINPROGRESS)
+ {
+  finish(h,false);
+  return;
+ }
+
+ h.state=HS_CONNECTING;
+
+ epoll_event ev={};
+ ev.events=EPOLLOUT;
+ ev.data.u32=id;
+ epoll_ctl(epfd,EPOLL_CTL_ADD,h.fd,&ev);
+}
+
+static void onEvent(Host& h,uint16_t id,uint32_t events)
+{
+ if(h.state==HS_CONNECTING)
+ {
+  int err=0;
+  socklen_t len=sizeof(err);
+  getsockopt(h.fd,SOL_SOCKET,SO_ERROR,&err,&len);
+
+  if(err || (events&EPOLLERR))
+  {
+   finish(h,false);
+   return;
+  }
+
+  h.state=HS_SENDING;
+ }
+
+ if(h.state==HS_SENDING)
+ {
+  ssize_t w=send(h.fd,h.reqText+h.reqSent,h.reqLen-h.reqSent,MSG_NOSIGNAL);
+
+  if(w<0)
+  {
+   if(errno!=EAGAIN) finish(h,false);
+   return;
+  }
+
+  h.reqSent+=w;
+  if(h.reqSent<h.reqLen) return;
+
+  h.state=HS_READING;
+
+  epoll_event ev={};
+  ev.events=EPOLLIN;
+  ev.data.u32=id;
+  epoll_ctl(epfd,EPOLL_CTL_MOD,h.fd,&ev);
+  return;
+ }
+
+ if(h.state==HS_READING)
+ {
+  for(;;)
+  {
+   // 버퍼가 차면 거기까지만 쓴다 (로그 앞부분은 이미 받은 줄이다)
+   if(h.len>=RESP_CAP)
+   {
+    handleResponse(h,id);
+    return;
+   }
+
+   ssize_t r=recv(h.fd,h.buf+h.len,RESP_CAP-h.len,0);
+
+   if(r>0)
+   {
+    h.len+=r;
+    continue;
+   }
+
+   if(r==0) handleResponse(h,id);
+   else if(errno!=EAGAIN) finish(h,false);
+   return;
+  }
+ }
+}
+
+// ---------------- 설정 ----------------
+// "host:port", "host:port+N" (포트 N 개), 끝에 "/status" 면 03 형식
+static bool addHosts(const char* spec)
+{
+ char tmp[128];
+ snprintf(tmp,sizeof(tmp),"%s",spec);
+
+ bool statusApi=false;
+ char* slash=strchr(tmp,'/');
+ if(slash)
+ {
+  statusApi=!strcmp(slash,"/status");
+  *slash=0;
+ }
+
+ int count=1;
+ char* plus=strchr(tmp,'+');
+ if(plus)
+ {
+  count=atoi(plus+1);
+  *plus=0;
+ }
+
+ char* colon=strrchr(tmp,':');
+ int port=colon?atoi(colon+1):80;
+ if(colon) *colon=0;
+
+ addrinfo hints={},*res=nullptr;
+ hints.ai_family=AF_INET;
+ hints.ai_socktype=SOCK_STREAM;
+
+ if(getaddrinfo(tmp,nullptr,&hints,&res)!=0)
+ {
+  fprintf(stderr,"cannot resolve %s\n",tmp);
+  return false;
+ }
+
+ for(int i=0;i<count;i++)
+ {
+  Host h;
+  h.addr=*(sockaddr_in*)res->ai_addr;
+  h.addr.sin_port=htons(port+i);
+  h.statusApi=statusApi;
+  h.req=statusApi?RQ_STATUS:RQ_LOGS;
+  snprintf(h.name,sizeof(h.name),"%.48s:%d",tmp,port+i);
+  hosts.push_back(h);
+ }
+
+ freeaddrinfo(res);
+ return true;
+}
+
+// ---------------- 덤프 ----------------
+static int dump(const char* path,bool csv)
+{
+ FILE* f=fopen(path,"rb");
+ if(!f)
+ {
+  perror(path);
+  return 1;
+ }
+
+ std::vector<std::string> names;
+ std::vector<unsigned long> count;
+ std::vector<uint32_t> first,last;
+ unsigned long total=0,blocks=0;
+
+ if(csv) printf("host,ts,air,hum,water,pump_rem,heater,fan,led,pump\n");
+
+ char magic[4];
+ while(fread(magic,1,4,f)==4)
+ {
+  uint32_t rows;
+  uint16_t n;
+
+  if(memcmp(magic,"FCB1",4) || fread(&rows,4,1,f)!=1 || fread(&n,2,1,f)!=1)
+  {
+   fprintf(stderr,"bad block at %ld\n",ftell(f));
+   return 1;
+  }
+
+  names.assign(n,"");
+  for(int i=0;i<n;i++)
+  {
+   uint16_t len;
+   char buf[256]={0};
+   if(fread(&len,2,1,f)!=1 || len>=sizeof(buf) || fread(buf,1,len,f)!=len) return 1;
+   names[i]=buf;
+  }
+
+  if(count.size()<n)
+  {
+   count.resize(n,0);
+   first.resize(n,0);
+   last.resize(n,0);
+  }
+
+  Columns c;
+  c.host.resize(rows);
+  c.ts.resize(rows);
+  c.air.resize(rows);
+  c.hum.resize(rows);
+  c.water.resize(rows);
+  c.pumpRem.resize(rows);
+  c.relays.resize(rows);
+
+  bool ok=fread(c.host.data(),2,rows,f)==rows && fread(c.ts.data(),4,rows,f)==rows
+  && fread(c.air.data(),2,rows,f)==rows && fread(c.hum.data(),2,rows,f)==rows
+  && fread(c.water.data(),2,rows,f)==rows && fread(c.pumpRem.data(),2,rows,f)==rows
+  && fread(c.relays.data(),1,rows,f)==rows;
+
+  if(!ok)
+  {
+   fprintf(stderr,"truncated block\n");
+   return 1;
+  }
+
+  for(uint32_t r=0;r<rows;r++)
+  {
+   uint16_t h=c.host[r];
+   if(h>=n) continue;
+
+   if(!count[h]++) first[h]=c.ts[r];
+   last[h]=c.ts[r];
+
+   if(!csv) continue;
+
+   printf("%s,%u",names[h].c_str(),c.ts[r]);
+   for(int16_t v:{c.air[r],c.hum[r],c.water[r]})
+   {
+    if(v==NA) printf(",");
+    else printf(",%.2f",v/100.0);
+   }
+   printf(",%u",c.pumpRem[r]);
+   for(int b=0;b<4;b++) printf(",%d",(c.relays[r]>>b)&1);
+   printf("\n");
+  }
+
+  total+=rows;
+  blocks++;
+ }
+
+ if(csv) return 0;
+
+ printf("%lu rows in %lu blocks, %zu hosts\n",total,blocks,names.size());
+ printf("%-22s %8s %10s\n","host","rows","span_s");
+ for(size_t i=0;i<names.size() && i<count.size();i++)
+ printf("%-22s %8lu %10u\n",names[i].c_str(),count[i],last[i]-first[i]);
+
+ return 0;
+}
+
+// ---------------- main ----------------
+static volatile sig_atomic_t stopFlag=0;
+
+static void onSignal(int)
+{
+ stopFlag=1;
+}
+
+static void usage(const char* argv0)
+{
+ fprintf(stderr,"usage: %s [--out file] [--interval ms] [--duration s] [--timeout ms] [--max-backoff ms]\n"
+ "          [--max-conn N] [--time-every N] host:port[+N][/status] ... | --hosts file\n"
+ "       %s --dump file [--csv]\n",argv0,argv0);
+}
+
+int main(int argc,char** argv)
+{
+ const char* outPath="fleet.col";
+ uint32_t durationSec=0;
+ int maxConn=256;
+
+ if(argc>=3 && !strcmp(argv[1],"--dump")) return dump(argv[2],argc>3 && !strcmp(argv[3],"--csv"));
+
+ for(int i=1;i<argc;i++)
+ {
+  std::string opt=argv[i];
+  bool hasValue=i+1<argc;
+
+  if(opt=="--out" && hasValue) outPath=argv[++i];
+  else if(opt=="--interval" && hasValue) intervalMs=atoi(argv[++i]);
+  else if(opt=="--duration" && hasValue) durationSec=atoi(argv[++i]);
+  else if(opt=="--timeout" && hasValue) timeoutMs=atoi(argv[++i]);
+  else if(opt=="--max-backoff" && hasValue) maxBackoffMs=atoi(argv[++i]);
+  else if(opt=="--max-conn" && hasValue) maxConn=atoi(argv[++i]);
+  else if(opt=="--time-every" && hasValue) timeEvery=atoi(argv[++i]);
+  else if(opt=="--hosts" && hasValue)
+  {
+   FILE* f=fopen(argv[++i],"r");
+   char line[128];
+   if(!f)
+   {
+    perror(argv[i]);
+    return 1;
+   }
+   while(fgets(line,sizeof(line),f))
+   {
+    line[strcspn(line,"\r\n# ")]=0;
+    if(line[0] && !addHosts(line)) return 1;
+   }
+   fclose(f);
+  }
+  else if(opt[0]!='-')
+  {
+   if(!addHosts(argv[i])) return 1;
+  }
+  else
+  {
+   usage(argv[0]);
+   return 2;
+  }
+ }
+
+ if(hosts.empty() || hosts.size()>65535)
+ {
+  usage(argv[0]);
+  return 2;
+ }
+
+ signal(SIGINT,onSignal);
+ signal(SIGTERM,onSignal);
+ signal(SIGPIPE,SIG_IGN);
+
+ rlimit rl={(rlim_t)maxConn+64,(rlim_t)maxConn+64};
+ setrlimit(RLIMIT_NOFILE,&rl);
+
+ outFile=fopen(outPath,"ab");
+ if(!outFile)
+ {
+  perror(outPath);
+  return 1;
+ }
+
+ // 응답 버퍼와 열 버퍼는 시작할 때 한 번만 잡는다
+ std::vector<char> arena(hosts.size()*(RESP_CAP+1));
+ cols.reserve(BLOCK_ROWS);
+
+ uint64_t start=nowMs();
+
+ for(size_t i=0;i<hosts.size();i++)
+ {
+  hosts[i].buf=arena.data()+i*(RESP_CAP+1);
+  hosts[i].nextMs=start+i*intervalMs/hosts.size();   // 첫 폴링을 주기 안에 고르게 편다
+ }
+
+ epfd=epoll_create1(0);
+
+ fprintf(stderr,"fleet_collector: %zu hosts, interval %u ms -> %s\n",hosts.size(),intervalMs,outPath);
+
+ std::vector<epoll_event> events(maxConn);
+ uint64_t lastReport=start;
+
+ while(!stopFlag)
+ {
+  uint64_t now=nowMs();
+
+  if(durationSec && now-start>=durationSec*1000ULL) break;
+
+  // 시간 초과, 시작할 폴링
+  uint64_t wake=now+500;
+
+  for(size_t i=0;i<hosts.size();i++)
+  {
+   Host& h=hosts[i];
+
+   if(h.state!=HS_IDLE)
+   {
+    if(now>=h.deadlineMs) finish(h,false);
+    else wake=std::min(wake,h.deadlineMs);
+   }
+
+   if(h.state==HS_IDLE)
+   {
+    if(now>=h.nextMs && active<maxConn) startPoll(h,i);
+    if(h.state==HS_IDLE) wake=std::min(wake,h.nextMs);
+   }
+  }
+
+  int wait=wake>now?(int)(wake-now):0;
+  int n=epoll_wait(epfd,events.data(),events.size(),wait);
+
+  for(int k=0;k<n;k++)
+  {
+   uint32_t id=events[k].data.u32;
+   onEvent(hosts[id],id,events[k].events);
+  }
+
+  if(nowMs()-lastReport>=10000)
+  {
+   lastReport=nowMs();
+
+   unsigned long ok=0,err=0,smp=0;
+   int backoff=0;
+   for(const Host& h:hosts)
+   {
+    ok+=h.ok;
+    err+=h.errors;
+    smp+=h.samples;
+    if(h.fails) backoff++;
+   }
+
+   fprintf(stderr,"[%5.0fs] ok=%lu err=%lu samples=%lu backoff_hosts=%d active=%d\n",
+   (lastReport-start)/1000.0,ok,err,smp,backoff,active);
+  }
+ }
+
+ flushBlock();
+ fclose(outFile);
+
+ printf("%-22s %8s %8s %8s %8s\n","host","ok","errors","samples","skew_s");
+ for(const Host& h:hosts)
+ {
+  printf("%-22s %8lu %8lu %8lu ",h.name,h.ok,h.errors,h.samples);
+  if(h.skewKnown) printf("%8d\n",h.skew);
+  else printf("%8s\n","-");
+ }
+ printf("rows written: %lu\n",rowsWritten);
+
+ return 0;
+}
@@ -0,0 +1,384 @@
+// 농장 장치 N 대를 흉내 내는 HTTP 서버 (호스트, fleet_collector 부하 시험용)
+//
+// 포트 base..base+N-1 에 장치 하나씩 열고 /api/logs, /api/time, /api/status 를 돌려준다.
+// 로그는 fish_plant_03/04 의 상태 한줄 형식 그대로이며, 장치마다 RTC 오차와 수온 곡선이 다르다.
+// 단일 스레드 epoll 로 모든 포트를 처리한다.
+//
+// 빌드: g++ -O2 -std=gnu++17 tools/fleet_sim.cpp -o fleet_sim
+// 실행: ./fleet_sim [--devices 200] [--port 9000] [--speed 1] [--fail 0.0] [--delay 0] [--down 0]
+//
+//  --speed S  장치 시간 배속 (상태 한줄은 장치 시간 5초마다)
+//  --fail P   요청마다 확률 P 로 503 을 주거나 응답 없이 끊는다
+//  --delay MS 응답을 MS 만큼 늦춘다
+//  --down K   마지막 K 대는 포트를 열지 않는다 (연결 거부 → 수집기 backoff 확인)
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+
+static const size_t LOG_LIMIT=12000;   // 장치 logBuffer 와 같은 크기
+static const uint32_t STATUS_SEC=5;
+
+struct Device
+{
+ int listenFd=-1;
+ int skew=0;               // RTC 오차(초)
+ float phase=0;
+ double startEpoch=0;
+ uint64_t lines=0;         // 지금까지 만든 상태 줄 수
+ std::string log;
+};
+
+struct Conn
+{
+ int fd;
+ int dev;
+ std::string req;
+ std::string resp;
+ size_t sent=0;
+ double due=0;             // 응답 보낼 시각 (--delay)
+ bool ready=false;
+};
+
+static volatile sig_atomic_t stopFlag=0;
+
+static void onSignal(int)
+{
+ stopFlag=1;
+}
+
+static double nowSec()
+{
+ timespec ts;
+ clock_gettime(CLOCK_REALTIME,&ts);
+ return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void formatTime(char* buf,size_t n,time_t t)
+{
+ tm v;
+ gmtime_r(&t,&v);
+ strftime(buf,n,"%Y-%m-%d %H:%M:%S",&v);
+}
+
+static double speed=1;
+
+// 장치 시각 (RTC 는 벽시계를 로컬 시간대로 맞춘 값이라 gmtime 으로 찍는다)
+static double deviceEpoch(const Device& d,double now)
+{
+ return d.startEpoch+(now-d.startEpoch)*speed+d.skew;
+}
+
+struct Sample
+{
+ float air,hum,water;
+ bool heater,fan,led,pump;
+ unsigned pumpRem;
+};
+
+static Sample sampleAt(const Device& d,uint64_t k)
+{
+ Sample s;
+ double t=k*STATUS_SEC;
+
+ s.water=24+2.5f*sinf(t/1800.0f+d.phase);
+ s.air=22+4*sinf(t/7200.0f+d.phase);
+ s.hum=60+10*sinf(t/3600.0f+d.phase*2);
+ s.heater=s.water<22.5f;
+ s.fan=s.water>25.5f;
+ s.led=true;
+
+ unsigned cyc=(unsigned)t%67;
+ s.pump=cyc>=60;
+ s.pumpRem=s.pump?67-cyc:60-cyc;
+
+ if(k%97==13) s.water=NAN;   // 가끔 센서 실패
+ return s;
+}
+
+// 마지막 요청 이후 흐른 장치 시간만큼 상태 줄을 덧붙인다
+static void advance(Device& d,double now)
+{
+ uint64_t want=(uint64_t)((now-d.startEpoch)*speed/STATUS_SEC);
+
+ if(want>d.lines+LOG_LIMIT/100) d.lines=want-LOG_LIMIT/100;
+
+ for(;d.lines<want;d.lines++)
+ {
+  Sample s=sampleAt(d,d.lines);
+  char ts[32],line[200];
+
+  formatTime(ts,sizeof(ts),(time_t)(d.startEpoch+d.skew+d.lines*STATUS_SEC));
+
+  snprintf(line,sizeof(line),"[%s] T=%.1fC H=%.1f%% W=%.2fC PUMP_REM=%02u:%02u HEATER=%s FAN=%s LED=%s PUMP=%s\n",
+  ts,s.air,s.hum,s.water,s.pumpRem/60,s.pumpRem%60,
+  s.heater?"ON":"OFF",s.fan?"ON":"OFF",s.led?"ON":"OFF",s.pump?"ON":"OFF");
+
+  d.log+=line;
+ }
+
+ if(d.log.size()>LOG_LIMIT)
+ {
+  size_t cut=d.log.find('\n',d.log.size()-LOG_LIMIT);
+  d.log.erase(0,cut==std::string::npos?d.log.size():cut+1);
+ }
+}
+
+static std::string response(int code,const char* type,const std::string& body)
+{
+ char hdr[160];
+ snprintf(hdr,sizeof(hdr),"HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+ code,code==200?"OK":code==404?"Not Found":"Service Unavailable",type,body.size());
+ return hdr+body;
+}
+
+static std::string route(Device& d,const std::string& path,double now)
+{
+ advance(d,now);
+
+ char ts[32];
+ formatTime(ts,sizeof(ts),(time_t)deviceEpoch(d,now));
+
+ if(path=="/api/logs") return response(200,"text/plain",d.log);
+ if(path=="/api/time") return response(200,"text/plain",ts);
+
+ if(path=="/api/status")
+ {
+  Sample s=sampleAt(d,d.lines?d.lines-1:0);
+  char body[300],w[16];
+
+  if(isnan(s.water)) strcpy(w,"null");
+  else snprintf(w,sizeof(w),"%.2f",s.water);
+
+  snprintf(body,sizeof(body),
+  "{\"now\":\"%s\",\"airTemp\":%.1f,\"hum\":%.1f,\"waterTemp\":%s,\"pumpRemain\":\"%02u:%02u\","
+  "\"heater\":%s,\"fan\":%s,\"led\":%s,\"pump\":%s}",
+  ts,s.air,s.hum,w,s.pumpRem/60,s.pumpRem%60,
+  s.heater?"true":"false",s.fan?"true":"false",s.led?"true":"false",s.pump?"true":"false");
+
+  return response(200,"application/json",body);
+ }
+
+ return response(404,"text/plain","not found");
+}
+
+int main(int argc,char** argv)
+{
+ int devices=200;
+ int basePort=9000;
+ double failRate=0;
+ double delayMs=0;
+ int down=0;
+
+ for(int i=1;i+1<argc;i+=2)
+ {
+  std::string opt=argv[i];
+  if(opt=="--devices") devices=atoi(argv[i+1]);
+  else if(opt=="--port") basePort=atoi(argv[i+1]);
+  else if(opt=="--speed") speed=atof(argv[i+1]);
+  else if(opt=="--fail") failRate=atof(argv[i+1]);
+  else if(opt=="--delay") delayMs=atof(argv[i+1]);
+  else if(opt=="--down") down=atoi(argv[i+1]);
+  else
+  {
+   fprintf(stderr,"usage: %s [--devices N] [--port P] [--speed S] [--fail P] [--delay MS] [--down K]\n",argv[0]);
+   return 2;
+  }
+ }
+
+ signal(SIGINT,onSignal);
+ signal(SIGTERM,onSignal);
+ signal(SIGPIPE,SIG_IGN);
+
+ rlimit rl={65536,65536};
+ setrlimit(RLIMIT_NOFILE,&rl);
+
+ std::mt19937 rng(1234);
+ std::uniform_real_distribution<double> uni(0,1);
+
+ int ep=epoll_create1(0);
+ double start=nowSec();
+
+ std::vector<Device> devs(devices);
+ std::vector<Conn*> conns;
+
+ for(int i=0;i<devices;i++)
+ {
+  Device& d=devs[i];
+
+  d.skew=(int)(uni(rng)*60)-30;
+  d.phase=uni(rng)*6.28f;
+  d.startEpoch=start;
+
+  if(i>=devices-down) continue;
+
+  d.listenFd=socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0);
+  int one=1;
+  setsockopt(d.listenFd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+  sockaddr_in a={};
+  a.sin_family=AF_INET;
+  a.sin_port=htons(basePort+i);
+  a.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+
+  if(bind(d.listenFd,(sockaddr*)&a,sizeof(a))<0 || listen(d.listenFd,64)<0)
+  {
+   perror("bind");
+   return 1;
+  }
+
+  epoll_event ev={};
+  ev.events=EPOLLIN;
+  ev.data.u64=(uint64_t)i<<1;         // 짝수: 리슨 소켓
+  epoll_ctl(ep,EPOLL_CTL_ADD,d.listenFd,&ev);
+ }
+
+ fprintf(stderr,"fleet_sim: %d devices on 127.0.0.1:%d-%d (%d down)\n",devices,basePort,basePort+devices-1,down);
+
+ unsigned long requests=0,failed=0;
+
+ auto closeConn=[&](Conn* c)
+ {
+  epoll_ctl(ep,EPOLL_CTL_DEL,c->fd,nullptr);
+  close(c->fd);
+  c->fd=-1;
+ };
+
+ auto flush=[&](Conn* c)
+ {
+  while(c->sent<c->resp.size())
+  {
+   ssize_t w=send(c->fd,c->resp.data()+c->sent,c->resp.size()-c->sent,MSG_NOSIGNAL);
+   if(w<=0)
+   {
+    if(w<0 && errno==EAGAIN)
+    {
+     epoll_event ev={};
+     ev.events=EPOLLOUT;
+     ev.data.u64=((uint64_t)(uintptr_t)c)|1;
+     epoll_ctl(ep,EPOLL_CTL_MOD,c->fd,&ev);
+     return;
+    }
+    break;
+   }
+   c->sent+=w;
+  }
+  closeConn(c);
+ };
+
+ epoll_event events[256];
+
+ while(!stopFlag)
+ {
+  int n=epoll_wait(ep,events,256,delayMs>0?5:200);
+  double now=nowSec();
+
+  for(int k=0;k<n;k++)
+  {
+   uint64_t tag=events[k].data.u64;
+
+   if(!(tag&1))
+   {
+    Device& d=devs[tag>>1];
+
+    for(;;)
+    {
+     int fd=accept4(d.listenFd,nullptr,nullptr,SOCK_NONBLOCK);
+     if(fd<0) break;
+
+     Conn* c=new Conn();
+     c->fd=fd;
+     c->dev=tag>>1;
+     conns.push_back(c);
+
+     epoll_event ev={};
+     ev.events=EPOLLIN;
+     ev.data.u64=((uint64_t)(uintptr_t)c)|1;
+     epoll_ctl(ep,EPOLL_CTL_ADD,fd,&ev);
+    }
+    continue;
+   }
+
+   Conn* c=(Conn*)(uintptr_t)(tag&~1ULL);
+   if(c->fd<0) continue;
+
+   if(c->ready)
+   {
+    flush(c);
+    continue;
+   }
+
+   char buf[2048];
+   ssize_t r=recv(c->fd,buf,sizeof(buf),0);
+
+   if(r<=0)
+   {
+    closeConn(c);
+    continue;
+   }
+
+   c->req.append(buf,r);
+   if(c->req.find("\r\n\r\n")==std::string::npos) continue;
+
+   requests++;
+
+   size_t sp=c->req.find(' ');
+   size_t sp2=c->req.find(' ',sp+1);
+   std::string path=c->req.substr(sp+1,sp2-sp-1);
+
+   if(failRate>0 && uni(rng)<failRate)
+   {
+    failed++;
+    if(uni(rng)<0.5)
+    {
+     closeConn(c);
+     continue;
+    }
+    c->resp=response(503,"text/plain","busy");
+   }
+   else c->resp=route(devs[c->dev],path,now);
+
+   c->ready=true;
+   c->due=now+delayMs/1000.0;
+
+   epoll_event ev={};
+   ev.data.u64=((uint64_t)(uintptr_t)c)|1;
+   epoll_ctl(ep,EPOLL_CTL_MOD,c->fd,&ev);  // 보낼 때까지 이벤트 없음
+
+   if(delayMs<=0) flush(c);
+  }
+
+  // 지연 응답 처리, 닫힌 연결 정리
+  for(size_t i=0;i<conns.size();)
+  {
+   Conn* c=conns[i];
+
+   if(c->fd>=0 && c->ready && c->sent==0 && now>=c->due) flush(c);
+
+   if(c->fd<0)
+   {
+    delete c;
+    conns[i]=conns.back();
+    conns.pop_back();
+   }
+   else i++;
+  }
+ }
+
+ fprintf(stderr,"fleet_sim: %lu requests, %lu failed on purpose\n",requests,failed);
+ return 0;
+}
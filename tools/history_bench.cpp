@@ -0,0 +1,276 @@
+// 센서 이력 압축 벤치마크 (호스트)
+//
+// fish_plant_04.cpp 의 이력 블록(delta-of-delta 시각 + 가변 길이 값 차이)에 수조 데이터를 넣어
+// 압축률과 인코드/디코드 처리량을 잰다. 데이터는 장치의 /api/trace 로 받은 트레이스를 쓰고,
+// 없으면 24시간짜리 수조 모델(DS18B20 0.0625도 분해능, DHT11 정수값)을 만든다.
+//
+// 빌드: g++ -O2 -std=gnu++17 -Itools/host -include Arduino.h tools/history_bench.cpp -lbenchmark -lpthread -o history_bench
+// 실행: ./history_bench [--trace trace.txt] --benchmark_counters_tabular=true
+//
+// 카운터
+//  B/sample     블록 헤더와 빈 꼬리까지 포함한 샘플당 바이트
+//  ratio_raw    고정 레이아웃(시각 4 + 값 3x2 = 10바이트) 대비 압축률
+//  ratio_text   logBuffer 의 센서 로그 세 줄(SENSOR/DHT11/DS18B20) 대비 압축률
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "host.h"
+
+#define PERF_ENABLE 0
+#define MQTT_ENABLE 0
+
+namespace v4
+{
+#include "../fish_plant_04.cpp"
+}
+
+using v4::HC_COUNT;
+
+struct Sample
+{
+ uint32_t t;
+ int16_t v[HC_COUNT];
+};
+
+static std::vector<Sample> samples;
+static const char* source="model";
+
+// farm-trace v1 의 S 줄: S,ms,air,hum,water
+static bool loadTrace(const char* path)
+{
+ std::ifstream in(path);
+ if(!in) return false;
+
+ std::string line;
+ uint32_t epoch=0,epochMs=0;
+
+ while(std::getline(in,line))
+ {
+  if(line.empty()) continue;
+
+  if(line[0]=='#')
+  {
+   size_t e=line.find("epoch=");
+   size_t m=line.find("ms=");
+   if(e!=std::string::npos) epoch=strtoul(line.c_str()+e+6,nullptr,10);
+   if(m!=std::string::npos) epochMs=strtoul(line.c_str()+m+3,nullptr,10);
+   continue;
+  }
+
+  std::vector<std::string> f;
+  std::stringstream ss(line);
+  std::string tok;
+  while(std::getline(ss,tok,',')) f.push_back(tok);
+
+  if(f.size()!=5 || f[0]!="S") continue;
+
+  auto val=[](const std::string& s){return s=="nan"?NAN:strtof(s.c_str(),nullptr);};
+  int32_t ms=strtoul(f[1].c_str(),nullptr,10);
+
+  Sample s;
+  s.t=epoch+(ms-(int32_t)epochMs)/1000;
+  s.v[v4::HC_AIR]=v4::toCenti(val(f[2]));
+  s.v[v4::HC_HUM]=v4::toPermille(val(f[3]));
+  s.v[v4::HC_WATER]=v4::toCenti(val(f[4]));
+  samples.push_back(s);
+ }
+
+ return !samples.empty();
+}
+
+// 수조 모델: 히터 ON 이면 오르고 OFF 면 식는다 (22.0~22.5 히스테리시스).
+// 5초 주기에 루프 지연으로 가끔 4/6초 간격, 2000 샘플에 한 번 DHT 읽기 실패.
+static void makeModel()
+{
+ uint32_t t=1772928000;
+ double water=24.0,air=24.0,hum=60.0;
+ bool heater=false;
+ uint32_t seed=12345;
+
+ auto rnd=[&](){seed=seed*1103515245+12345;return (seed>>16)&0x7FFF;};
+
+ for(int i=0;i<24*720;i++)
+ {
+  double hour=(i%17280)/720.0;
+
+  air=23.0+2.0*sin((hour-9)*M_PI/12)+(rnd()%100-50)/400.0;
+  hum=60.0-4.0*sin((hour-9)*M_PI/12)+(rnd()%100-50)/100.0;
+
+  if(water<=22.0) heater=true;
+  else if(water>=22.5) heater=false;
+  water+=heater?0.012:-0.004-(water-air)*0.0004;
+
+  Sample s;
+  s.t=t;
+  s.v[v4::HC_AIR]=(rnd()%2000==0)?v4::SENSOR_NA:(int16_t)lround(air)*100;
+  s.v[v4::HC_HUM]=(rnd()%2000==0)?v4::SENSOR_NA:(int16_t)lround(hum)*10;
+  s.v[v4::HC_WATER]=(int16_t)lround(floor(water*16)/16*100);
+  samples.push_back(s);
+
+  int r=rnd()%20;
+  t+=r==0?4:(r==1?6:5);
+ }
+}
+
+static void histReset()
+{
+ memset(v4::histBlocks,0,sizeof(v4::histBlocks));
+ v4::histBlockCount=0;
+}
+
+// 로그에 같은 샘플을 텍스트로 남길 때의 바이트 (시각 문자열 19자)
+static double textBytesPerSample()
+{
+ double total=0;
+ char tb[12],hb[12],wb[12],line[200];
+
+ for(const Sample& s:samples)
+ {
+  v4::fmtFixed(tb,s.v[v4::HC_AIR],2,1);
+  v4::fmtFixed(hb,s.v[v4::HC_HUM],1,1);
+  v4::fmtFixed(wb,s.v[v4::HC_WATER],2,2);
+
+  total+=snprintf(line,sizeof(line),"[0000-00-00 00:00:00] SENSOR\n[DHT11] Temp=%sC Hum=%s%%\n[DS18B20] Water=%sC\n",tb,hb,wb);
+ }
+
+ return total/samples.size();
+}
+
+// ---------------- 인코드 ----------------
+// 링이 넘쳐도 블록 수는 누적되므로 전체 샘플 기준 B/sample 을 구할 수 있다.
+static void BM_encode(benchmark::State& state)
+{
+ uint32_t blocks=0;
+
+ for(auto _:state)
+ {
+  histReset();
+  for(const Sample& s:samples) v4::histAppend(s.t,s.v);
+  blocks=v4::histBlockCount;
+  benchmark::ClobberMemory();
+ }
+
+ // 마지막 블록은 채워진 만큼만
+ const v4::HistBlock& last=v4::histBlocks[(blocks-1)%v4::HIST_BLOCKS];
+ double bytes=(blocks-1)*(double)v4::HIST_BLOCK_BYTES+v4::HIST_BLOCK_BYTES-sizeof(last.data)+(last.bits+7)/8;
+ double perSample=bytes/samples.size();
+
+ state.SetItemsProcessed(state.iterations()*samples.size());
+ state.counters["B/sample"]=perSample;
+ state.counters["ratio_raw"]=10.0/perSample;
+ state.counters["ratio_text"]=textBytesPerSample()/perSample;
+ state.SetLabel(source);
+}
+BENCHMARK(BM_encode);
+
+// ---------------- 디코드 ----------------
+// 링에 남은 만큼(최근 HIST_BLOCKS 블록)을 처음부터 끝까지 순서대로 푼다.
+static void BM_decode(benchmark::State& state)
+{
+ histReset();
+ for(const Sample& s:samples) v4::histAppend(s.t,s.v);
+
+ uint32_t stored,bytes;
+ v4::histUsage(stored,bytes);
+
+ // 왕복 확인: 디코드 결과는 입력의 마지막 stored 개와 같아야 한다
+ {
+  v4::HistReader r;
+  v4::histSeek(r,0);
+  size_t k=samples.size()-stored;
+
+  while(v4::histNext(r))
+  {
+   const Sample& s=samples[k++];
+   if(r.t!=s.t || memcmp(r.v,s.v,sizeof(s.v)))
+   {
+    state.SkipWithError("roundtrip mismatch");
+    return;
+   }
+  }
+ }
+
+ for(auto _:state)
+ {
+  v4::HistReader r;
+  int32_t sum=0;
+
+  v4::histSeek(r,0);
+  while(v4::histNext(r)) sum+=r.v[v4::HC_WATER];
+
+  benchmark::DoNotOptimize(sum);
+ }
+
+ state.SetItemsProcessed(state.iterations()*stored);
+ state.SetBytesProcessed(state.iterations()*bytes);
+ state.counters["B/sample"]=(double)bytes/stored;
+ state.SetLabel(source);
+}
+BENCHMARK(BM_decode);
+
+// 구간 조회: 이분 탐색으로 블록을 찾고 한 시간(720 샘플)만 푼다
+static void BM_decodeRange(benchmark::State& state)
+{
+ histReset();
+ for(const Sample& s:samples) v4::histAppend(s.t,s.v);
+
+ uint32_t to=samples.back().t;
+ uint32_t from=to-3600;
+ long n=0;
+
+ for(auto _:state)
+ {
+  v4::HistReader r;
+  n=0;
+
+  v4::histSeek(r,from);
+  while(v4::histNext(r))
+  {
+   if(r.t<from) continue;
+   if(r.t>to) break;
+   n++;
+  }
+
+  benchmark::DoNotOptimize(n);
+ }
+
+ state.SetItemsProcessed(state.iterations()*n);
+}
+BENCHMARK(BM_decodeRange);
+
+int main(int argc,char** argv)
+{
+ benchmark::Initialize(&argc,argv);
+
+ for(int i=1;i<argc;i++)
+ {
+  std::string opt=argv[i];
+
+  if(opt=="--trace" && i+1<argc)
+  {
+   source=argv[++i];
+   if(!loadTrace(source))
+   {
+    fprintf(stderr,"cannot read trace %s\n",source);
+    return 1;
+   }
+  }
+  else
+  {
+   fprintf(stderr,"usage: %s [--trace trace.txt] [benchmark options]\n",argv[0]);
+   return 2;
+  }
+ }
+
+ if(samples.empty()) makeModel();
+
+ benchmark::RunSpecifiedBenchmarks();
+ benchmark::Shutdown();
+
+ return 0;
+}
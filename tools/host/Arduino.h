@@ -0,0 +1,293 @@
+// 호스트(리눅스)용 Arduino HAL.
+// 스케치를 그대로 g++로 컴파일하기 위한 최소 구현이며, 시간/센서/핀 상태는
+// hal:: 네임스페이스 전역으로 노출되어 도구가 직접 조작한다.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+// ESP32 코어도 C++ 에서는 std::min/max 를 쓴다
+using std::min;
+using std::max;
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#define PROGMEM
+#define PGM_P const char*
+#define F(s) (s)
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+namespace hal
+{
+ inline uint64_t nowUs=0;
+
+ inline uint8_t pinLevel[40]={0};
+
+ struct PinWrite
+ {
+  uint64_t us;
+  uint8_t pin;
+  uint8_t level;
+ };
+
+ inline std::vector<PinWrite> pinWrites;
+
+ inline std::string serialOut;
+ inline bool serialCapture=true;
+ inline bool serialEcho=false;
+ inline std::string serialIn;
+ inline std::mutex serialLock;
+
+ inline void advanceMs(uint64_t ms){nowUs+=ms*1000ULL;}
+
+ inline void writePin(uint8_t pin,uint8_t level)
+ {
+  if(pin>=40) return;
+  pinLevel[pin]=level;
+  pinWrites.push_back({nowUs,pin,level});
+ }
+}
+
+namespace hal
+{
+ // GPIO set/clear 레지스터 쓰기 기록. 핀 상태(pinWrites)에도 반영한다.
+ struct RegWrite
+ {
+  uint64_t us;
+  uint32_t reg;
+  uint32_t value;
+ };
+
+ inline std::vector<RegWrite> regWrites;
+
+ inline void regWrite(uint32_t reg,uint32_t value)
+ {
+  regWrites.push_back({nowUs,reg,value});
+
+  int base=(reg==0x3FF44014 || reg==0x3FF44018)?32:0;
+  uint8_t level=(reg==0x3FF44008 || reg==0x3FF44014)?1:0;
+
+  for(int b=0;b<32;b++)
+  if(value&(1UL<<b)) writePin(base+b,level);
+ }
+}
+
+namespace hal
+{
+ // esp_timer.h 가 포함되면 만기 타이머를 발화시킨다.
+ inline void (*onTimeRead)()=nullptr;
+
+ inline uint64_t readTime()
+ {
+  if(onTimeRead) onTimeRead();
+  return nowUs;
+ }
+}
+
+inline unsigned long millis(){return (unsigned long)(hal::readTime()/1000ULL);}
+inline unsigned long micros(){return (unsigned long)hal::readTime();}
+inline void delay(unsigned long ms){hal::advanceMs(ms);}
+inline void delayMicroseconds(unsigned int us){hal::nowUs+=us;}
+inline void yield(){}
+
+inline void pinMode(uint8_t,uint8_t){}
+inline void digitalWrite(uint8_t pin,uint8_t level){hal::writePin(pin,level?1:0);}
+inline int digitalRead(uint8_t pin){return pin<40?hal::pinLevel[pin]:0;}
+
+// ---------------- String ----------------
+class String
+{
+public:
+ String(){}
+ String(const char* s):s_(s?s:""){}
+ String(const std::string& s):s_(s){}
+ String(char c):s_(1,c){}
+ String(int v):s_(std::to_string(v)){}
+ String(unsigned int v):s_(std::to_string(v)){}
+ String(long v):s_(std::to_string(v)){}
+ String(unsigned long v):s_(std::to_string(v)){}
+ String(float v,unsigned int dec=2){fmt(v,dec);}
+ String(double v,unsigned int dec=2){fmt(v,dec);}
+
+ const char* c_str() const{return s_.c_str();}
+ unsigned int length() const{return (unsigned int)s_.size();}
+ void reserve(unsigned int n){s_.reserve(n);}
+ void remove(unsigned int index,unsigned int count){if(index<s_.size()) s_.erase(index,count);}
+ void remove(unsigned int index){if(index<s_.size()) s_.erase(index);}
+ int indexOf(const char* s) const{size_t p=s_.find(s);return p==std::string::npos?-1:(int)p;}
+ String substring(unsigned int a,unsigned int b) const{return a<s_.size()?String(s_.substr(a,b-a)):String();}
+ String substring(unsigned int a) const{return a<s_.size()?String(s_.substr(a)):String();}
+ long toInt() const{return strtol(s_.c_str(),nullptr,10);}
+ float toFloat() const{return strtof(s_.c_str(),nullptr);}
+ bool startsWith(const char* p) const{return s_.rfind(p,0)==0;}
+ bool equalsIgnoreCase(const char* o) const{return strcasecmp(s_.c_str(),o)==0;}
+ char operator[](unsigned int i) const{return i<s_.size()?s_[i]:0;}
+ bool operator==(const char* o) const{return s_==o;}
+ bool operator!=(const char* o) const{return s_!=o;}
+ bool operator==(const String& o) const{return s_==o.s_;}
+
+ String& operator+=(const String& o){s_+=o.s_;return *this;}
+ String& operator+=(const char* o){s_+=o;return *this;}
+ String& operator+=(char c){s_+=c;return *this;}
+ String& operator+=(int v){s_+=std::to_string(v);return *this;}
+ String& operator+=(unsigned long v){s_+=std::to_string(v);return *this;}
+
+ friend String operator+(const String& a,const String& b){return String(a.s_+b.s_);}
+ friend String operator+(const String& a,const char* b){return String(a.s_+b);}
+ friend String operator+(const char* a,const String& b){return String(std::string(a)+b.s_);}
+
+private:
+ void fmt(double v,unsigned int dec)
+ {
+  char b[48];
+  snprintf(b,sizeof(b),"%.*f",(int)dec,v);
+  s_=b;
+ }
+
+ std::string s_;
+};
+
+// ---------------- Serial ----------------
+class Print
+{
+public:
+ virtual ~Print(){}
+ virtual size_t write(uint8_t c)=0;
+
+ virtual size_t write(const uint8_t* b,size_t n)
+ {
+  for(size_t i=0;i<n;i++) write(b[i]);
+  return n;
+ }
+
+ size_t write(const char* s,size_t n){return write((const uint8_t*)s,n);}
+ size_t print(const char* s){return write((const uint8_t*)s,strlen(s));}
+ size_t print(const String& s){return print(s.c_str());}
+ size_t print(char c){return write((uint8_t)c);}
+ size_t print(int v){return print(String(v));}
+ size_t print(unsigned int v){return print(String(v));}
+ size_t print(long v){return print(String(v));}
+ size_t print(unsigned long v){return print(String(v));}
+ size_t print(double v,int dec=2){return print(String(v,dec));}
+ size_t println(){return print("\r\n");}
+ template<class T> size_t println(const T& v){size_t n=print(v);return n+println();}
+
+ size_t printf(const char* fmt,...)
+ {
+  char b[512];
+  va_list ap;
+  va_start(ap,fmt);
+  int n=vsnprintf(b,sizeof(b),fmt,ap);
+  va_end(ap);
+  if(n<0) return 0;
+  return write((const uint8_t*)b,(size_t)n<sizeof(b)?n:sizeof(b)-1);
+ }
+};
+
+class HardwareSerial:public Print
+{
+public:
+ void begin(unsigned long){}
+ void flush(){}
+ int available(){return (int)hal::serialIn.size();}
+
+ int read()
+ {
+  if(hal::serialIn.empty()) return -1;
+  int c=(uint8_t)hal::serialIn[0];
+  hal::serialIn.erase(0,1);
+  return c;
+ }
+
+ int availableForWrite(){return 128;}
+
+ using Print::write;
+
+ size_t write(uint8_t c) override{return write(&c,1);}
+
+ size_t write(const uint8_t* b,size_t n) override
+ {
+  std::lock_guard<std::mutex> g(hal::serialLock);
+  if(hal::serialCapture) hal::serialOut.append((const char*)b,n);
+  if(hal::serialEcho) fwrite(b,1,n,stdout);
+  return n;
+ }
+
+ operator bool() const{return true;}
+};
+
+inline HardwareSerial Serial;
+
+// ---------------- ESP ----------------
+namespace hal
+{
+ inline uint32_t heapFree=200000;
+ inline uint32_t heapMinFree=180000;
+ inline uint32_t heapMaxAlloc=110000;
+}
+
+class EspClass
+{
+public:
+ uint32_t getFreeHeap(){return hal::heapFree;}
+ uint32_t getMinFreeHeap(){return hal::heapMinFree;}
+ uint32_t getMaxAllocHeap(){return hal::heapMaxAlloc;}
+ uint32_t getHeapSize(){return 320000;}
+ uint32_t getCpuFreqMHz(){return 240;}
+ uint32_t getCycleCount(){return (uint32_t)(hal::nowUs*240ULL);}
+ void restart(){}
+};
+
+inline EspClass ESP;
+
+// ---------------- FreeRTOS ----------------
+// 태스크는 분리된 std::thread 로 실행되고 vTaskDelay 는 실제 시간만큼 잔다.
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+
+namespace hal
+{
+ inline unsigned stackHighWater=4096;
+}
+
+typedef std::recursive_mutex portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(m) (m)->lock()
+#define portEXIT_CRITICAL(m) (m)->unlock()
+
+inline unsigned uxTaskGetStackHighWaterMark(TaskHandle_t){return hal::stackHighWater;}
+
+inline void vTaskDelay(TickType_t ticks){std::this_thread::sleep_for(std::chrono::milliseconds(ticks));}
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*fn)(void*),const char*,uint32_t,void* arg,
+ unsigned,TaskHandle_t* handle,int)
+{
+ std::thread t(fn,arg);
+ if(handle) *handle=(TaskHandle_t)1;
+ t.detach();
+ return pdPASS;
+}
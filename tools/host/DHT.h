@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define DHT11 11
+#define DHT22 22
+
+namespace hal
+{
+ inline float airTemp=24.0f;
+ inline float humidity=60.0f;
+ inline unsigned long dhtReads=0;
+}
+
+class DHT
+{
+public:
+ DHT(uint8_t,uint8_t){}
+ void begin(){}
+ // force: 라이브러리의 2초 캐시를 무시하고 다시 읽는다 (호스트에서는 항상 새로 읽음)
+ float readTemperature(bool S=false,bool force=false){hal::dhtReads++;return hal::airTemp;}
+ float readHumidity(bool force=false){hal::dhtReads++;return hal::humidity;}
+};
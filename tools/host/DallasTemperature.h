@@ -0,0 +1,38 @@
+#pragma once
+
+#include "OneWire.h"
+
+#define DEVICE_DISCONNECTED_C -127
+
+namespace hal
+{
+ inline float waterTemp=24.0f;
+ inline uint8_t waterResolution=12;
+ inline unsigned long waterConversions=0;
+ inline uint64_t waterConversionDoneUs=0;
+}
+
+class DallasTemperature
+{
+public:
+ explicit DallasTemperature(OneWire*){}
+ void begin(){}
+ void setResolution(uint8_t bits){hal::waterResolution=bits;}
+ void setWaitForConversion(bool wait){wait_=wait;}
+
+ // 해상도별 변환시간(9bit 94ms ~ 12bit 750ms)을 가상 시간으로 흉내낸다.
+ uint16_t millisToWaitForConversion() const{return 750>>(12-hal::waterResolution);}
+
+ void requestTemperatures()
+ {
+  hal::waterConversions++;
+  hal::waterConversionDoneUs=hal::nowUs+millisToWaitForConversion()*1000ULL;
+  if(wait_) hal::nowUs=hal::waterConversionDoneUs;
+ }
+
+ bool isConversionComplete(){return hal::nowUs>=hal::waterConversionDoneUs;}
+ float getTempCByIndex(uint8_t){return hal::waterTemp;}
+
+private:
+ bool wait_=true;
+};
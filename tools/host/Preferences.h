@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+
+#include "Arduino.h"
+
+// NVS 대신 프로세스 메모리에 저장한다. 같은 프로세스 안에서는 재부팅(setup 재호출) 후에도 남는다.
+namespace hal
+{
+ inline std::map<std::string,std::string> nvs;
+ inline unsigned long nvsWrites=0;
+}
+
+class Preferences
+{
+public:
+ bool begin(const char* name,bool readOnly=false){ns_=name;ro_=readOnly;return true;}
+ void end(){}
+
+ size_t putBytes(const char* key,const void* value,size_t len)
+ {
+  if(ro_) return 0;
+  hal::nvs[k(key)].assign((const char*)value,len);
+  hal::nvsWrites++;
+  return len;
+ }
+
+ size_t getBytesLength(const char* key)
+ {
+  auto it=hal::nvs.find(k(key));
+  return it==hal::nvs.end()?0:it->second.size();
+ }
+
+ size_t getBytes(const char* key,void* buf,size_t maxLen)
+ {
+  auto it=hal::nvs.find(k(key));
+  if(it==hal::nvs.end() || it->second.size()>maxLen) return 0;
+  memcpy(buf,it->second.data(),it->second.size());
+  return it->second.size();
+ }
+
+ size_t putUInt(const char* key,uint32_t v){return putBytes(key,&v,sizeof(v));}
+
+ uint32_t getUInt(const char* key,uint32_t def=0)
+ {
+  uint32_t v;
+  return getBytes(key,&v,sizeof(v))==sizeof(v)?v:def;
+ }
+
+ size_t putFloat(const char* key,float v){return putBytes(key,&v,sizeof(v));}
+
+ float getFloat(const char* key,float def=NAN)
+ {
+  float v;
+  return getBytes(key,&v,sizeof(v))==sizeof(v)?v:def;
+ }
+
+ bool remove(const char* key){return hal::nvs.erase(k(key))>0;}
+
+private:
+ std::string k(const char* key) const{return ns_+"/"+key;}
+
+ std::string ns_;
+ bool ro_=false;
+};
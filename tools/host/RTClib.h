@@ -0,0 +1,55 @@
+#pragma once
+
+#include <time.h>
+
+#include "Arduino.h"
+
+namespace hal
+{
+ // RTC가 가리키는 유닉스 시각 = epochBase + 가상 경과시간
+ inline uint32_t epochBase=1772928000; // 2026-03-08 00:00:00
+}
+
+class DateTime
+{
+public:
+ DateTime(uint32_t t=0):t_(t)
+ {
+  time_t tt=(time_t)t;
+  gmtime_r(&tt,&tm_);
+ }
+
+ DateTime(uint16_t y,uint8_t mo,uint8_t d,uint8_t h=0,uint8_t mi=0,uint8_t s=0)
+ {
+  struct tm tm={};
+  tm.tm_year=y-1900;
+  tm.tm_mon=mo-1;
+  tm.tm_mday=d;
+  tm.tm_hour=h;
+  tm.tm_min=mi;
+  tm.tm_sec=s;
+  t_=(uint32_t)timegm(&tm);
+  time_t tt=(time_t)t_;
+  gmtime_r(&tt,&tm_);
+ }
+
+ uint16_t year() const{return tm_.tm_year+1900;}
+ uint8_t month() const{return tm_.tm_mon+1;}
+ uint8_t day() const{return tm_.tm_mday;}
+ uint8_t hour() const{return tm_.tm_hour;}
+ uint8_t minute() const{return tm_.tm_min;}
+ uint8_t second() const{return tm_.tm_sec;}
+ uint32_t unixtime() const{return t_;}
+
+private:
+ uint32_t t_;
+ struct tm tm_;
+};
+
+class RTC_DS3231
+{
+public:
+ bool begin(){return true;}
+ void adjust(const DateTime& dt){hal::epochBase=dt.unixtime()-(uint32_t)(hal::nowUs/1000000ULL);}
+ DateTime now(){return DateTime(hal::epochBase+(uint32_t)(hal::nowUs/1000000ULL));}
+};
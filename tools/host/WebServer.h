@@ -0,0 +1,103 @@
+#pragma once
+
+#include <map>
+
+#include "WiFi.h"
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+namespace hal
+{
+ struct Response
+ {
+  int code=0;
+  std::string type;
+  std::string body;
+  int chunks=0;
+  std::map<std::string,std::string> headers;
+ };
+
+ inline Response lastResponse;
+}
+
+// 호스트 WebServer: 핸들러를 등록해 두고 hal::request()로 직접 호출한다.
+class WebServer
+{
+public:
+ typedef std::function<void(void)> THandlerFunction;
+
+ explicit WebServer(int){}
+
+ void on(const char* uri,THandlerFunction fn){handlers_[uri]=fn;}
+ void begin(){}
+ void handleClient(){}
+
+ bool hasArg(const char* name) const{return args_.count(name)>0;}
+
+ String arg(const char* name) const
+ {
+  auto it=args_.find(name);
+  return it==args_.end()?String():String(it->second);
+ }
+
+ String uri() const{return String(uri_);}
+
+ void setContentLength(size_t len){contentLength_=len;}
+
+ void sendHeader(const String& name,const String& value,bool first=false)
+ {
+  hal::lastResponse.headers[name.c_str()]=value.c_str();
+ }
+
+ void send(int code,const char* type,const String& body)
+ {
+  hal::lastResponse.code=code;
+  hal::lastResponse.type=type;
+  hal::lastResponse.body=body.c_str();
+ }
+
+ void send(int code,const char* type,const char* body)
+ {
+  hal::lastResponse.code=code;
+  hal::lastResponse.type=type;
+  hal::lastResponse.body=body;
+ }
+
+ void send(int code){send(code,"text/plain","");}
+
+ void send_P(int code,PGM_P type,PGM_P body){send(code,type,body);}
+
+ void send_P(int code,PGM_P type,PGM_P body,size_t len)
+ {
+  hal::lastResponse.code=code;
+  hal::lastResponse.type=type;
+  hal::lastResponse.body.assign(body,len);
+ }
+
+ void sendContent(const char* data,size_t len)
+ {
+  hal::lastResponse.body.append(data,len);
+  hal::lastResponse.chunks++;
+ }
+
+ void sendContent(const String& s){sendContent(s.c_str(),s.length());}
+ void sendContent(const char* s){sendContent(s,strlen(s));}
+
+ // 도구에서 요청을 흉내낸다.
+ bool request(const std::string& uri,const std::map<std::string,std::string>& args={})
+ {
+  auto it=handlers_.find(uri);
+  hal::lastResponse=hal::Response();
+  if(it==handlers_.end()) return false;
+  uri_=uri;
+  args_=args;
+  it->second();
+  return true;
+ }
+
+private:
+ std::map<std::string,THandlerFunction> handlers_;
+ std::map<std::string,std::string> args_;
+ std::string uri_;
+ size_t contentLength_=0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Arduino.h"
+
+typedef enum{WIFI_OFF,WIFI_STA,WIFI_AP,WIFI_AP_STA} wifi_mode_t;
+
+typedef enum{WL_IDLE_STATUS=0,WL_CONNECTED=3,WL_DISCONNECTED=6} wl_status_t;
+
+class IPAddress
+{
+public:
+ IPAddress(uint8_t a=0,uint8_t b=0,uint8_t c=0,uint8_t d=0){o_[0]=a;o_[1]=b;o_[2]=c;o_[3]=d;}
+ uint8_t operator[](int i) const{return o_[i];}
+
+ String toString() const
+ {
+  char b[16];
+  snprintf(b,sizeof(b),"%u.%u.%u.%u",o_[0],o_[1],o_[2],o_[3]);
+  return String(b);
+ }
+
+private:
+ uint8_t o_[4];
+};
+
+#include "WiFiClient.h"
+#include "WiFiUdp.h"
+
+namespace hal
+{
+ inline wl_status_t wifiStatus=WL_CONNECTED;
+}
+
+class WiFiClass
+{
+public:
+ bool mode(wifi_mode_t){return true;}
+ bool softAP(const char*,const char*){return true;}
+ IPAddress softAPIP(){return IPAddress(192,168,4,1);}
+ IPAddress softAPBroadcastIP(){return IPAddress(127,255,255,255);}
+ IPAddress localIP(){return IPAddress(127,0,0,1);}
+ IPAddress broadcastIP(){return IPAddress(127,255,255,255);}
+ void begin(const char*,const char*){}
+ void setAutoReconnect(bool){}
+ wl_status_t status(){return hal::wifiStatus;}
+};
+
+inline WiFiClass WiFi;
@@ -0,0 +1,142 @@
+// WiFiClient 를 리눅스 TCP 소켓으로 대신한다. 호스트에서 실제 브로커/서버와 통신할 수 있다.
+#pragma once
+
+#include "Arduino.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+class WiFiClient
+{
+public:
+ ~WiFiClient(){stop();}
+
+ // timeout: ms (ESP32 코어와 같은 의미)
+ int connect(const char* host,uint16_t port,int32_t timeout=3000)
+ {
+  stop();
+
+  addrinfo hints={},*res=nullptr;
+  hints.ai_family=AF_INET;
+  hints.ai_socktype=SOCK_STREAM;
+
+  char portStr[8];
+  snprintf(portStr,sizeof(portStr),"%u",port);
+
+  if(getaddrinfo(host,portStr,&hints,&res)!=0) return 0;
+
+  fd_=socket(AF_INET,SOCK_STREAM,0);
+  fcntl(fd_,F_SETFL,O_NONBLOCK);
+
+  int r=::connect(fd_,res->ai_addr,res->ai_addrlen);
+  freeaddrinfo(res);
+
+  if(r<0 && errno==EINPROGRESS)
+  {
+   pollfd p={fd_,POLLOUT,0};
+   int err=0;
+   socklen_t len=sizeof(err);
+
+   if(poll(&p,1,timeout)==1) getsockopt(fd_,SOL_SOCKET,SO_ERROR,&err,&len);
+   else err=ETIMEDOUT;
+
+   r=err?-1:0;
+  }
+
+  if(r<0)
+  {
+   stop();
+   return 0;
+  }
+
+  fcntl(fd_,F_SETFL,0);
+  return 1;
+ }
+
+ size_t write(const uint8_t* buf,size_t n)
+ {
+  if(fd_<0) return 0;
+
+  size_t done=0;
+
+  while(done<n)
+  {
+   ssize_t w=send(fd_,buf+done,n-done,MSG_NOSIGNAL);
+   if(w<=0)
+   {
+    stop();
+    break;
+   }
+   done+=w;
+  }
+
+  return done;
+ }
+
+ size_t write(uint8_t b){return write(&b,1);}
+
+ int available()
+ {
+  if(fd_<0) return 0;
+
+  int n=0;
+  ioctl(fd_,FIONREAD,&n);
+  return n;
+ }
+
+ int read(uint8_t* buf,size_t n)
+ {
+  if(fd_<0) return -1;
+
+  ssize_t r=recv(fd_,buf,n,MSG_DONTWAIT);
+  if(r==0) stop();
+  return r>0?(int)r:-1;
+ }
+
+ int read()
+ {
+  uint8_t b;
+  return read(&b,1)==1?b:-1;
+ }
+
+ // 상대가 닫았으면 false
+ uint8_t connected()
+ {
+  if(fd_<0) return 0;
+
+  uint8_t b;
+  ssize_t r=recv(fd_,&b,1,MSG_PEEK|MSG_DONTWAIT);
+
+  if(r==0 || (r<0 && errno!=EAGAIN && errno!=EWOULDBLOCK))
+  {
+   stop();
+   return 0;
+  }
+
+  return 1;
+ }
+
+ int setNoDelay(bool on)
+ {
+  int v=on;
+  return fd_<0?-1:setsockopt(fd_,IPPROTO_TCP,TCP_NODELAY,&v,sizeof(v));
+ }
+
+ void stop()
+ {
+  if(fd_>=0) close(fd_);
+  fd_=-1;
+ }
+
+ operator bool(){return connected();}
+
+private:
+ int fd_=-1;
+};
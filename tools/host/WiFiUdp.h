@@ -0,0 +1,65 @@
+// WiFiUDP 를 리눅스 UDP 소켓으로 대신한다. 송신 전용(브로드캐스트 허용).
+#pragma once
+
+#include "Arduino.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+class WiFiUDP
+{
+public:
+ ~WiFiUDP(){stop();}
+
+ uint8_t begin(uint16_t port)
+ {
+  stop();
+
+  fd_=socket(AF_INET,SOCK_DGRAM,0);
+
+  int one=1;
+  setsockopt(fd_,SOL_SOCKET,SO_BROADCAST,&one,sizeof(one));
+
+  sockaddr_in a={};
+  a.sin_family=AF_INET;
+  a.sin_port=htons(port);
+  return bind(fd_,(sockaddr*)&a,sizeof(a))==0;
+ }
+
+ int beginPacket(IPAddress ip,uint16_t port)
+ {
+  if(fd_<0 && !begin(0)) return 0;
+
+  memset(&to_,0,sizeof(to_));
+  to_.sin_family=AF_INET;
+  to_.sin_port=htons(port);
+  to_.sin_addr.s_addr=htonl((uint32_t)ip[0]<<24|(uint32_t)ip[1]<<16|(uint32_t)ip[2]<<8|ip[3]);
+  buf_.clear();
+  return 1;
+ }
+
+ size_t write(const uint8_t* p,size_t n)
+ {
+  buf_.insert(buf_.end(),p,p+n);
+  return n;
+ }
+
+ size_t write(uint8_t b){return write(&b,1);}
+
+ int endPacket()
+ {
+  return sendto(fd_,buf_.data(),buf_.size(),0,(sockaddr*)&to_,sizeof(to_))==(ssize_t)buf_.size();
+ }
+
+ void stop()
+ {
+  if(fd_>=0) close(fd_);
+  fd_=-1;
+ }
+
+private:
+ int fd_=-1;
+ sockaddr_in to_={};
+ std::vector<uint8_t> buf_;
+};
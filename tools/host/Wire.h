@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Arduino.h"
+
+class TwoWire
+{
+public:
+ bool begin(int=-1,int=-1){return true;}
+};
+
+inline TwoWire Wire;
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Arduino.h"
+
+// esp_timer 를 가상 시간 위에서 흉내낸다. 만기된 타이머는 millis()/micros()/esp_timer_get_time()
+// 호출 시점에 발화하며, 콜백 동안 가상 시간은 만기 시각으로 맞춰진다.
+typedef int esp_err_t;
+
+#define ESP_OK 0
+
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum{ESP_TIMER_TASK,ESP_TIMER_ISR} esp_timer_dispatch_t;
+
+typedef struct
+{
+ esp_timer_cb_t callback;
+ void* arg;
+ esp_timer_dispatch_t dispatch_method;
+ const char* name;
+ bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer
+{
+ esp_timer_cb_t cb;
+ void* arg;
+ uint64_t deadlineUs;
+ uint64_t periodUs;
+ bool armed;
+};
+
+typedef esp_timer* esp_timer_handle_t;
+
+namespace hal
+{
+ inline std::vector<esp_timer*> timers;
+
+ inline void pollTimers()
+ {
+  static bool busy=false;
+  if(busy) return;
+  busy=true;
+
+  for(;;)
+  {
+   esp_timer* next=nullptr;
+   for(esp_timer* t:timers)
+   if(t->armed && t->deadlineUs<=nowUs && (!next || t->deadlineUs<next->deadlineUs)) next=t;
+
+   if(!next) break;
+
+   uint64_t saved=nowUs;
+   nowUs=next->deadlineUs;
+
+   if(next->periodUs) next->deadlineUs+=next->periodUs;
+   else next->armed=false;
+
+   next->cb(next->arg);
+   nowUs=saved;
+  }
+
+  busy=false;
+ }
+
+ struct TimerHookInstaller
+ {
+  TimerHookInstaller(){onTimeRead=pollTimers;}
+ };
+
+ inline TimerHookInstaller timerHookInstaller;
+}
+
+inline int64_t esp_timer_get_time(){hal::pollTimers();return (int64_t)hal::nowUs;}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args,esp_timer_handle_t* out)
+{
+ esp_timer* t=new esp_timer{args->callback,args->arg,0,0,false};
+ hal::timers.push_back(t);
+ *out=t;
+ return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t t,uint64_t us)
+{
+ t->deadlineUs=hal::nowUs+us;
+ t->periodUs=0;
+ t->armed=true;
+ return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t t,uint64_t us)
+{
+ t->deadlineUs=hal::nowUs+us;
+ t->periodUs=us;
+ t->armed=true;
+ return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t t)
+{
+ t->armed=false;
+ return ESP_OK;
+}
@@ -0,0 +1,16 @@
+// 호스트 HAL 전체. 스케치를 namespace 안에 #include 하는 도구는 이 파일을 먼저 포함해야
+// 스케치 안의 #include 가 전역에서 한 번만 처리된다.
+#pragma once
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "WebServer.h"
+#include "Wire.h"
+#include "RTClib.h"
+#include "DHT.h"
+#include "OneWire.h"
+#include "DallasTemperature.h"
+#include "Preferences.h"
+#include "esp_timer.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
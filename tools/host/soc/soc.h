@@ -0,0 +1,6 @@
+#pragma once
+
+#include "Arduino.h"
+
+// 레지스터 쓰기는 hal::regWrite 로 기록된다 (soc/gpio_reg.h 참고).
+#define REG_WRITE(reg,val) ::hal::regWrite((uint32_t)(reg),(uint32_t)(val))
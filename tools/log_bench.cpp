@@ -0,0 +1,302 @@
+// 로그/포맷 경로 마이크로벤치마크 (호스트)
+//
+// fish_plant_03.cpp(String 버전)와 fish_plant_04.cpp(char[] 버전)를 호스트 HAL로
+// 그대로 컴파일해서 시간 문자열, logRelay, appendLog, handleStatusLine 의 ns/op 와
+// op당 복사 바이트를 잰다. RTC(I2C)와 UART 지연은 HAL에서 0 이므로 순수 CPU 비용이다.
+//
+// 빌드: g++ -O2 -std=gnu++17 -Itools/host -include Arduino.h tools/log_bench.cpp -lbenchmark -lpthread -o log_bench
+// 실행: ./log_bench --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+
+#include "host.h"
+
+#define PERF_ENABLE 0
+
+namespace v3
+{
+#include "../fish_plant_03.cpp"
+}
+
+namespace v4
+{
+#include "../fish_plant_04.cpp"
+}
+
+static const char STATUS_SAMPLE[]=
+"[2026-03-08 12:00:00] T=24.0C H=60.0% W=24.31C PUMP_REM=00:42 HEATER=OFF FAN=OFF LED=ON PUMP=OFF";
+
+static void initHal()
+{
+ hal::serialCapture=false;
+ hal::nowUs=12ULL*3600ULL*1000000ULL;
+ hal::airTemp=24.0f;
+ hal::humidity=60.0f;
+ hal::waterTemp=24.31f;
+}
+
+// 로그 버퍼를 가득 채워 밀어내기(memmove / String::remove)가 일어나는 정상 상태로 만든다.
+static void fillV3()
+{
+ while(v3::logBuffer.length()<v3::LOG_LIMIT) v3::appendLog(STATUS_SAMPLE);
+}
+
+static void fillV4()
+{
+ v4::rtcNow=v4::rtc.now();
+ while(v4::logIndex<10000) v4::appendLog(STATUS_SAMPLE);
+}
+
+// ---------------- 시간 문자열 ----------------
+static void BM_v3_nowString(benchmark::State& state)
+{
+ initHal();
+ size_t bytes=0;
+
+ for(auto _:state)
+ {
+  String s=v3::nowString();
+  bytes+=s.length();
+  benchmark::DoNotOptimize(s);
+ }
+
+ state.counters["bytes/op"]=benchmark::Counter((double)bytes/state.iterations());
+}
+BENCHMARK(BM_v3_nowString);
+
+// 같은 초 안의 반복 호출 (한 틱에 상태줄/센서/릴레이 로그가 모두 부르는 경우)
+static void BM_v4_nowStr(benchmark::State& state)
+{
+ initHal();
+ v4::rtcNow=v4::rtc.now();
+ size_t bytes=0;
+
+ for(auto _:state)
+ {
+  const char* t=v4::nowStr();
+  bytes+=19;
+  benchmark::DoNotOptimize(t);
+ }
+
+ state.counters["bytes/op"]=benchmark::Counter((double)bytes/state.iterations());
+}
+BENCHMARK(BM_v4_nowStr);
+
+// 매번 초가 바뀌는 경우: 분 안에서는 초 두 자리만, 분이 바뀌면 전체를 다시 만든다
+static void BM_v4_nowStrTick(benchmark::State& state)
+{
+ initHal();
+ uint32_t e=v4::rtc.now().unixtime();
+
+ for(auto _:state)
+ {
+  v4::rtcNow=DateTime(++e);
+  const char* t=v4::nowStr();
+  benchmark::DoNotOptimize(t);
+ }
+}
+BENCHMARK(BM_v4_nowStrTick);
+
+// 캐시 없이 매번 snprintf (이전 getNow)
+static void BM_v4_nowSnprintf(benchmark::State& state)
+{
+ initHal();
+ uint32_t e=v4::rtc.now().unixtime();
+ char buf[32];
+
+ for(auto _:state)
+ {
+  v4::rtcNow=DateTime(++e);
+  snprintf(buf,sizeof(buf),"%04d-%02d-%02d %02d:%02d:%02d",
+  v4::rtcNow.year(),v4::rtcNow.month(),v4::rtcNow.day(),
+  v4::rtcNow.hour(),v4::rtcNow.minute(),v4::rtcNow.second());
+  benchmark::DoNotOptimize(buf);
+ }
+}
+BENCHMARK(BM_v4_nowSnprintf);
+
+// ---------------- appendLog ----------------
+// 복사 바이트 = 추가된 줄 + 버퍼 앞부분을 밀어낼 때 옮겨진 바이트
+static void BM_v3_appendLog(benchmark::State& state)
+{
+ initHal();
+ fillV3();
+ String line(STATUS_SAMPLE);
+ size_t bytes=0;
+
+ for(auto _:state)
+ {
+  size_t before=v3::logBuffer.length();
+  v3::appendLog(line);
+  size_t after=v3::logBuffer.length();
+  bytes+=line.length()+1;
+  if(after<before+line.length()+1) bytes+=after;
+ }
+
+ state.counters["bytes/op"]=benchmark::Counter((double)bytes/state.iterations());
+}
+BENCHMARK(BM_v3_appendLog);
+
+static void BM_v4_appendLog(benchmark::State& state)
+{
+ initHal();
+ fillV4();
+ size_t len=strlen(STATUS_SAMPLE);
+ size_t bytes=0;
+
+ for(auto _:state)
+ {
+  int before=v4::logIndex;
+  v4::appendLog(STATUS_SAMPLE);
+  bytes+=len+1;
+  if(v4::logIndex<before) bytes+=before-2000;
+ }
+
+ state.counters["bytes/op"]=benchmark::Counter((double)bytes/state.iterations());
+}
+BENCHMARK(BM_v4_appendLog);
+
+// ---------------- logRelay ----------------
+static void BM_v3_logRelay(benchmark::State& state)
+{
+ initHal();
+ fillV3();
+ bool on=false;
+
+ for(auto _:state)
+ {
+  v3::logRelay("HEATER",on);
+  on=!on;
+ }
+}
+BENCHMARK(BM_v3_logRelay);
+
+static void BM_v4_logRelay(benchmark::State& state)
+{
+ initHal();
+ fillV4();
+ bool on=false;
+
+ for(auto _:state)
+ {
+  v4::logRelay(v4::RID_HEATER,on);
+  v4::logDrain();
+  on=!on;
+ }
+}
+BENCHMARK(BM_v4_logRelay);
+
+// ---------------- handleStatusLine ----------------
+// 5초 주기 검사를 통과하도록 매 반복마다 가상 시간을 5초 진행한다.
+static void BM_v3_handleStatusLine(benchmark::State& state)
+{
+ initHal();
+ fillV3();
+ v3::lastAirTemp=24.0f;
+ v3::lastHum=60.0f;
+ v3::lastWaterTemp=24.31f;
+
+ for(auto _:state)
+ {
+  hal::advanceMs(5000);
+  v3::handleStatusLine();
+ }
+}
+BENCHMARK(BM_v3_handleStatusLine);
+
+static void BM_v4_handleStatusLine(benchmark::State& state)
+{
+ initHal();
+ fillV4();
+ v4::lastAirTemp=2400;
+ v4::lastHum=600;
+ v4::lastWaterTemp=2431;
+
+ for(auto _:state)
+ {
+  hal::advanceMs(5000);
+  v4::handleStatusLine();
+ }
+}
+BENCHMARK(BM_v4_handleStatusLine);
+
+// ---------------- 센서값 표현 ----------------
+// float + "%.2f" 와 centi/per-mille 정수 + fmtFixed 의 포맷 비용, 샘플 저장 크기 비교
+static const float AIR_SAMPLES[8]={24.0f,23.9f,24.1f,-1.5f,24.3f,25.0f,22.8f,24.4f};
+
+static void BM_float_format(benchmark::State& state)
+{
+ char buf[16];
+ size_t bytes=0;
+ unsigned i=0;
+
+ for(auto _:state)
+ {
+  bytes+=snprintf(buf,sizeof(buf),"%.2f",AIR_SAMPLES[i++&7]);
+  benchmark::DoNotOptimize(buf);
+ }
+
+ state.counters["bytes/op"]=benchmark::Counter((double)bytes/state.iterations());
+}
+BENCHMARK(BM_float_format);
+
+static void BM_fixed_format(benchmark::State& state)
+{
+ v4::centi_t samples[8];
+ for(int k=0;k<8;k++) samples[k]=v4::toCenti(AIR_SAMPLES[k]);
+
+ char buf[16];
+ size_t bytes=0;
+ unsigned i=0;
+
+ for(auto _:state)
+ {
+  bytes+=v4::fmtFixed(buf,samples[i++&7],2,2);
+  benchmark::DoNotOptimize(buf);
+ }
+
+ state.counters["bytes/op"]=benchmark::Counter((double)bytes/state.iterations());
+}
+BENCHMARK(BM_fixed_format);
+
+// 1시간치(5초 주기 720개) 샘플을 배치에 쌓는 비용. bytes/op 는 샘플 하나의 저장 크기
+static void BM_float_store(benchmark::State& state)
+{
+ static float batch[720][3];
+ unsigned i=0;
+
+ for(auto _:state)
+ {
+  float *b=batch[i++%720];
+  b[0]=AIR_SAMPLES[i&7];
+  b[1]=60.0f;
+  b[2]=24.31f;
+  benchmark::DoNotOptimize(b);
+ }
+
+ state.counters["bytes/op"]=sizeof(batch[0]);
+}
+BENCHMARK(BM_float_store);
+
+static void BM_fixed_store(benchmark::State& state)
+{
+ v4::centi_t samples[8];
+ for(int k=0;k<8;k++) samples[k]=v4::toCenti(AIR_SAMPLES[k]);
+
+ static int16_t batch[720][3];
+ unsigned i=0;
+
+ for(auto _:state)
+ {
+  int16_t *b=batch[i++%720];
+  b[0]=samples[i&7];
+  b[1]=600;
+  b[2]=2431;
+  benchmark::DoNotOptimize(b);
+ }
+
+ state.counters["bytes/op"]=sizeof(batch[0]);
+}
+BENCHMARK(BM_fixed_store);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,328 @@
+// 최소 MQTT 브로커 (호스트, mosquitto 대용)
+//
+// fish_plant_04 의 MQTT 발행을 리눅스에서 확인하기 위한 단일 스레드 브로커.
+// MQTT 3.1.1 의 CONNECT/PUBLISH(QoS0,1)/SUBSCRIBE/PINGREQ/DISCONNECT 만 처리한다.
+// 받은 PUBLISH 는 "topic payload" 한 줄로 출력하고, 구독자(mosquitto_sub 등)에게도 전달한다.
+//
+// 빌드: g++ -O2 -std=gnu++17 tools/mqtt_broker.cpp -o mqtt_broker
+// 실행: ./mqtt_broker [--port 1883] [--kick N] [--quiet]
+//
+//  --kick N  클라이언트가 PUBLISH 를 N 개 보낼 때마다 PUBACK 없이 연결을 끊는다 (재접속/재전송 확인용)
+//  --quiet   메시지 출력 없이 종료 시 요약만
+//
+// payload 에 "seq":N 이 있으면 클라이언트 ID 별로 순서를 검사한다.
+// 건너뛴 seq 는 장치 큐에서 버려진 메시지(gap), 이미 받은 seq 는 재전송(dup)으로 센다.
+// QoS1 재전송은 마지막으로 확인된 메시지 다음부터 순서대로 오므로 dup 뒤에는 seq 가 다시 이어져야 한다.
+// Ctrl-C 로 끝내면 클라이언트별 수신/gap/dup 요약을 출력한다. dup_noflag 는 DUP 비트 없이 온 재전송이다.
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+struct Client
+{
+ int fd;
+ std::string id;
+ std::vector<uint8_t> in;
+ std::vector<std::string> filters;
+ unsigned long publishes=0;
+};
+
+struct SeqCheck
+{
+ unsigned long received=0;
+ unsigned long gaps=0;
+ unsigned long dups=0;
+ unsigned long dupNoFlag=0; // 재전송인데 DUP 비트가 없는 것 (3.3.1.1 위반)
+ long last=-1;
+};
+
+static volatile sig_atomic_t stopFlag=0;
+
+static void onSignal(int)
+{
+ stopFlag=1;
+}
+
+// '+' 한 단계, '#' 나머지 전부
+static bool topicMatch(const std::string& filter,const std::string& topic)
+{
+ size_t f=0,t=0;
+
+ while(f<filter.size())
+ {
+  if(filter[f]=='#') return true;
+
+  if(filter[f]=='+')
+  {
+   while(t<topic.size() && topic[t]!='/') t++;
+   f++;
+  }
+  else
+  {
+   if(t>=topic.size() || filter[f]!=topic[t]) return false;
+   f++;
+   t++;
+  }
+ }
+
+ return t==topic.size();
+}
+
+static void sendAll(int fd,const uint8_t* p,size_t n)
+{
+ while(n)
+ {
+  ssize_t w=send(fd,p,n,MSG_NOSIGNAL);
+  if(w<=0) return;
+  p+=w;
+  n-=w;
+ }
+}
+
+static std::string str16(const uint8_t* p,size_t& off,size_t end)
+{
+ if(off+2>end) return "";
+ size_t len=(p[off]<<8)|p[off+1];
+ off+=2;
+ if(off+len>end) len=end-off;
+ std::string s((const char*)p+off,len);
+ off+=len;
+ return s;
+}
+
+static void encodeRemaining(std::vector<uint8_t>& out,size_t len)
+{
+ do
+ {
+  uint8_t b=len%128;
+  len/=128;
+  if(len) b|=0x80;
+  out.push_back(b);
+ }
+ while(len);
+}
+
+int main(int argc,char** argv)
+{
+ int port=1883;
+ unsigned long kick=0;
+ bool quiet=false;
+
+ for(int i=1;i<argc;i++)
+ {
+  std::string opt=argv[i];
+  if(opt=="--port" && i+1<argc) port=atoi(argv[++i]);
+  else if(opt=="--kick" && i+1<argc) kick=strtoul(argv[++i],nullptr,10);
+  else if(opt=="--quiet") quiet=true;
+  else
+  {
+   fprintf(stderr,"usage: %s [--port 1883] [--kick N] [--quiet]\n",argv[0]);
+   return 2;
+  }
+ }
+
+ signal(SIGINT,onSignal);
+ signal(SIGTERM,onSignal);
+
+ int lfd=socket(AF_INET,SOCK_STREAM,0);
+ int one=1;
+ setsockopt(lfd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+ sockaddr_in addr={};
+ addr.sin_family=AF_INET;
+ addr.sin_port=htons(port);
+ addr.sin_addr.s_addr=htonl(INADDR_ANY);
+
+ if(bind(lfd,(sockaddr*)&addr,sizeof(addr))<0 || listen(lfd,16)<0)
+ {
+  perror("bind");
+  return 1;
+ }
+
+ fprintf(stderr,"mqtt_broker listening on :%d\n",port);
+
+ std::vector<Client> clients;
+ std::map<std::string,SeqCheck> seqs;
+
+ while(!stopFlag)
+ {
+  std::vector<pollfd> pfds;
+  pfds.push_back({lfd,POLLIN,0});
+  for(const Client& c:clients) pfds.push_back({c.fd,POLLIN,0});
+
+  if(poll(pfds.data(),pfds.size(),500)<0) continue;
+
+  if(pfds[0].revents&POLLIN)
+  {
+   int fd=accept(lfd,nullptr,nullptr);
+   if(fd>=0) clients.push_back({fd});
+  }
+
+  std::vector<int> closing;
+
+  for(size_t k=1;k<pfds.size();k++)
+  {
+   if(!(pfds[k].revents&(POLLIN|POLLHUP|POLLERR))) continue;
+
+   Client& c=clients[k-1];
+   uint8_t buf[4096];
+   ssize_t r=recv(c.fd,buf,sizeof(buf),0);
+
+   if(r<=0)
+   {
+    closing.push_back(c.fd);
+    continue;
+   }
+
+   c.in.insert(c.in.end(),buf,buf+r);
+
+   // 완성된 패킷만 처리
+   for(;;)
+   {
+    size_t len=0,mul=1,pos=1;
+    bool complete=false;
+
+    while(pos<c.in.size() && pos<5)
+    {
+     uint8_t b=c.in[pos++];
+     len+=(b&0x7F)*mul;
+     mul*=128;
+     if(!(b&0x80))
+     {
+      complete=true;
+      break;
+     }
+    }
+
+    if(!complete || c.in.size()<pos+len) break;
+
+    const uint8_t* p=c.in.data();
+    uint8_t type=p[0]>>4;
+    size_t end=pos+len;
+    size_t off=pos;
+
+    if(type==1)          // CONNECT
+    {
+     str16(p,off,end);   // "MQTT"
+     off+=4;             // level, flags, keepalive
+     c.id=str16(p,off,end);
+
+     const uint8_t ack[4]={0x20,2,0,0};
+     sendAll(c.fd,ack,4);
+
+     fprintf(stderr,"connect %s\n",c.id.c_str());
+    }
+    else if(type==3)     // PUBLISH
+    {
+     std::string topic=str16(p,off,end);
+     int qos=(p[0]>>1)&3;
+     uint8_t idHi=0,idLo=0;
+
+     if(qos)
+     {
+      idHi=p[off];
+      idLo=p[off+1];
+      off+=2;
+     }
+
+     std::string payload((const char*)p+off,end-off);
+     bool kicked=kick && ++c.publishes%kick==0;
+
+     if(!quiet) printf("%s %s\n",topic.c_str(),payload.c_str());
+
+     size_t s=payload.find("\"seq\":");
+     if(s!=std::string::npos)
+     {
+      SeqCheck& sc=seqs[c.id];
+      long seq=strtol(payload.c_str()+s+6,nullptr,10);
+
+      sc.received++;
+      if(sc.last>=0 && seq<=sc.last)
+      {
+       sc.dups++;
+       if(!(p[0]&0x08)) sc.dupNoFlag++;
+      }
+      else if(sc.last>=0 && seq>sc.last+1) sc.gaps+=seq-sc.last-1;
+      if(seq>sc.last) sc.last=seq;
+     }
+
+     for(const Client& o:clients)
+     for(const std::string& f:o.filters)
+     if(topicMatch(f,topic))
+     {
+      std::vector<uint8_t> out(p,p+end);
+      out[0]&=0xF9;      // 구독자에게는 QoS0
+      sendAll(o.fd,out.data(),out.size());
+      break;
+     }
+
+     if(kicked) closing.push_back(c.fd);
+     else if(qos)
+     {
+      const uint8_t ack[4]={0x40,2,idHi,idLo};
+      sendAll(c.fd,ack,4);
+     }
+    }
+    else if(type==8)     // SUBSCRIBE
+    {
+     uint8_t idHi=p[off],idLo=p[off+1];
+     off+=2;
+
+     std::vector<uint8_t> ack={0x90};
+     std::vector<uint8_t> codes;
+
+     while(off<end)
+     {
+      c.filters.push_back(str16(p,off,end));
+      off++;             // 요청 QoS
+      codes.push_back(0);
+     }
+
+     encodeRemaining(ack,2+codes.size());
+     ack.push_back(idHi);
+     ack.push_back(idLo);
+     ack.insert(ack.end(),codes.begin(),codes.end());
+     sendAll(c.fd,ack.data(),ack.size());
+    }
+    else if(type==12)    // PINGREQ
+    {
+     const uint8_t resp[2]={0xD0,0};
+     sendAll(c.fd,resp,2);
+    }
+    else if(type==14)    // DISCONNECT
+    closing.push_back(c.fd);
+
+    c.in.erase(c.in.begin(),c.in.begin()+end);
+   }
+  }
+
+  fflush(stdout);
+
+  for(int fd:closing)
+  for(size_t i=0;i<clients.size();i++)
+  if(clients[i].fd==fd)
+  {
+   fprintf(stderr,"disconnect %s\n",clients[i].id.c_str());
+   close(fd);
+   clients.erase(clients.begin()+i);
+   break;
+  }
+ }
+
+ fprintf(stderr,"\n%-16s %10s %8s %8s %10s\n","client","received","gaps","dups","dup_noflag");
+ for(const auto& kv:seqs)
+ fprintf(stderr,"%-16s %10lu %8lu %8lu %10lu\n",kv.first.c_str(),kv.second.received,kv.second.gaps,
+ kv.second.dups,kv.second.dupNoFlag);
+
+ return 0;
+}
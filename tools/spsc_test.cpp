@@ -0,0 +1,241 @@
+// SpscRing 동시성 시험 (호스트)
+//
+// 스케치의 SpscRing 을 그대로 가져와 생산자 스레드 하나와 소비자 스레드 하나로 돌린다.
+// 비었거나 꽉 차면 yield 하므로 코어가 하나인 머신에서도 끝난다.
+// 펌웨어의 수집/제어/로그 단계는 loop 에서 차례로 불리므로, 링의 양쪽이 실제로 동시에 도는
+// 경우는 이 시험이 확인한다.
+//
+// 빌드: g++ -O2 -std=gnu++17 -Itools/host -include Arduino.h tools/spsc_test.cpp -o spsc_test -lpthread
+// TSan: g++ -O1 -g -fsanitize=thread -std=gnu++17 -Itools/host -include Arduino.h tools/spsc_test.cpp -o spsc_test_tsan -lpthread
+// 실행: ./spsc_test [--count 1000000]
+//
+// 시험
+//  retry  push 가 실패하면 다시 넣는다. 소비자는 0,1,2... 를 빠짐없이 순서대로 받아야 하고
+//         dropped() 는 생산자가 센 실패 횟수와 같아야 한다.
+//  drop   pushAll 로 두 조각을 한 번에 넣고 실패해도 다시 넣지 않는다. 소비자는 peek/consume 로
+//         묶어서 꺼낸다. 받은 seq 는 계속 커져야 하고, 한 묶음은 전부 오거나 전부 빠져야 하며,
+//         받은 개수 + dropped() = 보낸 개수, 받은 seq 합 + 버린 seq 합 = 보낸 seq 합 이어야 한다.
+//         항목은 두 워드짜리라 찢어진 읽기(check 불일치)도 잡는다.
+
+#include <string>
+#include <thread>
+
+#include "host.h"
+
+#define PERF_ENABLE 0
+#define MQTT_ENABLE 0
+
+namespace v4
+{
+#include "../fish_plant_04.cpp"
+}
+
+struct Item
+{
+ uint32_t seq;
+ uint32_t check;
+};
+
+// 하위 28비트는 seq 에서 나온 값, 상위 4비트는 묶음 첫 항목일 때 묶음 길이
+static uint32_t checkOf(uint32_t seq)
+{
+ return (~seq*2654435761u)&0x0FFFFFFFu;
+}
+
+static int failures=0;
+
+static void fail(const char* test,const char* what,unsigned long a,unsigned long b)
+{
+ printf("FAIL %-5s %s: %lu / %lu\n",test,what,a,b);
+ failures++;
+}
+
+static void testRetry(uint32_t count)
+{
+ static v4::SpscRing<uint32_t,64> ring;
+
+ uint32_t orderErrors=0;
+ uint32_t received=0;
+
+ std::thread consumer([&]
+ {
+  uint32_t expect=0,v;
+
+  while(expect<count)
+  {
+   if(!ring.pop(v))
+   {
+    std::this_thread::yield();
+    continue;
+   }
+
+   if(v!=expect && orderErrors++==0) printf("FAIL retry order: got %u expected %u\n",v,expect);
+   expect=v+1;
+   received++;
+  }
+ });
+
+ uint32_t retries=0;
+
+ for(uint32_t i=0;i<count;)
+ {
+  if(ring.push(i)) i++;
+  else
+  {
+   retries++;
+   std::this_thread::yield();
+  }
+ }
+
+ consumer.join();
+
+ if(orderErrors) fail("retry","order errors",orderErrors,0);
+ if(received!=count) fail("retry","received",received,count);
+ if(ring.dropped()!=retries) fail("retry","dropped vs retries",ring.dropped(),retries);
+ if(ring.peak()>ring.capacity()) fail("retry","peak > capacity",ring.peak(),ring.capacity());
+
+ printf("retry  sent=%u received=%u retries=%u dropped=%u peak=%u/%u\n",
+ count,received,retries,ring.dropped(),ring.peak(),ring.capacity());
+}
+
+static void testDrop(uint32_t count)
+{
+ static v4::SpscRing<Item,64> ring;
+ static std::atomic<bool> done{false};
+
+ uint64_t receivedSum=0;
+ uint32_t received=0;
+ uint32_t orderErrors=0;
+ uint32_t tornErrors=0;
+ uint32_t splitErrors=0;
+
+ std::thread consumer([&]
+ {
+  long last=-1;
+  uint32_t batchLeft=0;
+
+  for(;;)
+  {
+   bool finished=done.load(std::memory_order_acquire);
+
+   const Item* p;
+   uint32_t n=ring.peek(p);
+
+   if(!n)
+   {
+    if(finished) break;
+    std::this_thread::yield();
+    continue;
+   }
+
+   for(uint32_t i=0;i<n;i++)
+   {
+    const Item& it=p[i];
+
+    uint32_t seq=it.seq;
+    uint32_t len=it.check>>28;
+
+    if((it.check&0x0FFFFFFFu)!=checkOf(seq) && tornErrors++==0)
+    printf("FAIL drop torn item: seq=%u check=%08x\n",seq,it.check);
+
+    if((long)seq<=last && orderErrors++==0) printf("FAIL drop order: got %u after %ld\n",seq,last);
+
+    // 묶음이 중간에 끊기면 다음 묶음의 첫 항목이 너무 일찍 온다
+    if(len)
+    {
+     if(batchLeft && splitErrors++==0) printf("FAIL drop batch split before seq %u\n",seq);
+     batchLeft=len;
+    }
+    else if(!batchLeft && splitErrors++==0) printf("FAIL drop stray item seq %u\n",seq);
+
+    if(batchLeft) batchLeft--;
+
+    last=seq;
+    receivedSum+=seq;
+    received++;
+   }
+
+   ring.consume(n);
+  }
+
+  if(batchLeft) splitErrors++;
+ });
+
+ uint64_t sentSum=0,droppedSum=0;
+ uint32_t seq=0;
+ uint32_t batches=0,droppedBatches=0;
+ uint32_t rng=1;
+
+ Item a[8],b[4];
+
+ while(seq<count)
+ {
+  rng=rng*1103515245u+12345u;
+
+  uint32_t na=1+(rng>>16)%7;
+  uint32_t nb=(rng>>24)%4;
+  if(seq+na+nb>count)
+  {
+   na=1;
+   nb=0;
+  }
+
+  uint64_t sum=0;
+
+  for(uint32_t i=0;i<na+nb;i++)
+  {
+   Item& it=i<na?a[i]:b[i-na];
+   it.seq=seq+i;
+   it.check=checkOf(it.seq);
+   sum+=it.seq;
+  }
+
+  a[0].check|=(na+nb)<<28; // 최대 10
+
+  if(!ring.pushAll(a,na,b,nb))
+  {
+   droppedSum+=sum;
+   droppedBatches++;
+   std::this_thread::yield(); // 코어가 하나여도 소비자가 따라잡을 틈을 준다
+  }
+
+  sentSum+=sum;
+  seq+=na+nb;
+  batches++;
+ }
+
+ done.store(true,std::memory_order_release);
+ consumer.join();
+
+ if(orderErrors) fail("drop","order errors",orderErrors,0);
+ if(tornErrors) fail("drop","torn items",tornErrors,0);
+ if(splitErrors) fail("drop","split batches",splitErrors,0);
+ if(received+ring.dropped()!=count) fail("drop","received+dropped vs sent",received+ring.dropped(),count);
+ if(receivedSum+droppedSum!=sentSum) fail("drop","seq sums",receivedSum+droppedSum,sentSum);
+ if(ring.peak()>ring.capacity()) fail("drop","peak > capacity",ring.peak(),ring.capacity());
+
+ printf("drop   sent=%u received=%u dropped=%u batches=%u/%u dropped peak=%u/%u\n",
+ count,received,ring.dropped(),droppedBatches,batches,ring.peak(),ring.capacity());
+}
+
+int main(int argc,char** argv)
+{
+ uint32_t count=1000000;
+
+ for(int i=1;i<argc;i++)
+ {
+  std::string opt=argv[i];
+  if(opt=="--count" && i+1<argc) count=strtoul(argv[++i],nullptr,10);
+  else
+  {
+   fprintf(stderr,"usage: %s [--count N]\n",argv[0]);
+   return 2;
+  }
+ }
+
+ testRetry(count);
+ testDrop(count);
+
+ printf("%s\n",failures?"FAILED":"OK");
+ return failures?1:0;
+}
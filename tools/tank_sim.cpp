@@ -0,0 +1,233 @@
+// 수조 폐루프 시뮬레이터 (호스트)
+//
+// fish_plant_04 를 호스트 HAL 로 그대로 돌리면서, 히터/팬 GPIO 출력으로 수조 열 모델을 움직이고
+// 모델 수온을 다시 DS18B20 값으로 넣는다. 고정 히스테리시스와 자동 조정(/api/tune)을 같은 조건에서
+// 돌려 릴레이 사이클 수와 수온 이탈을 비교한다. 모드마다 fork 한 프로세스에서 돌아 서로 섞이지 않는다.
+//
+// 빌드: g++ -O2 -std=gnu++17 -Itools/host -include Arduino.h tools/tank_sim.cpp -o tank_sim
+// 실행: ./tank_sim [--liters 200] [--heater 300] [--loss 15] [--room 21] [--swing 3]
+//                  [--noise 0.2] [--hours 72] [--target 4] [--tick 500] [--seed 1]
+//
+// 모델
+//  - 히터 주변(수조의 10%)과 본체 두 덩어리. 히터 열은 주변을 먼저 데우고 mix(W/K)로 본체에 퍼진다.
+//    히터가 꺼진 뒤에도 본체가 계속 오르는 오버슈트가 여기서 나온다.
+//  - 본체는 실온(하루 주기 사인)으로 loss(W/K) 만큼 열을 잃고, 팬은 fan(W) 만큼 더 식힌다.
+//  - 센서값 = 본체 수온 + 가우시안 잡음, 0.0625도 단위. 큰 수조의 층 분리/물 흐름을 잡음으로 본다.
+//
+// 출력 (모드별 한 줄)
+//  heater/last24  히터 시간당 사이클 (전체 / 마지막 24시간)
+//  fan            팬 시간당 사이클
+//  energy_Wh      히터 + 팬 에너지
+//  min/max        실제 수온 최저/최고
+//  out_%          실제 수온이 [HEATER_ON-0.25, FAN_ON+0.25] 밖에 있던 시간 비율
+//  heater_off / fan_off / adj  끝났을 때의 OFF 경계와 조정 횟수
+
+#include <string>
+#include <random>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "host.h"
+
+#define PERF_ENABLE 0
+#define MQTT_ENABLE 0
+
+namespace v4
+{
+#include "../fish_plant_04.cpp"
+}
+
+static const uint8_t PIN_HEATER=14;
+static const uint8_t PIN_FAN=25;
+static const uint32_t SIM_EPOCH=1772928000; // 자정에서 시작
+
+struct Params
+{
+ double liters=200;
+ double heaterW=300;
+ double fanW=40;
+ double lossWK=15;
+ double mixWK=150;
+ double room=21;
+ double swing=3;
+ double noise=0.2;
+ double start=23;
+ double hours=72;
+ int target=v4::TUNE_TARGET_CPH;
+ uint32_t tickMs=500;
+ uint32_t seed=1;
+};
+
+struct Result
+{
+ unsigned long heaterCycles=0;
+ unsigned long heaterCyclesLast=0;
+ unsigned long fanCycles=0;
+ double energyWh=0;
+ double tMin=1e9;
+ double tMax=-1e9;
+ double outSec=0;
+};
+
+static double roomAt(const Params& p,double sec)
+{
+ double hour=fmod(sec/3600.0,24.0);
+ return p.room+p.swing*sin((hour-9)*M_PI/12); // 15시 최고
+}
+
+static void simulate(const Params& p,bool autoTune)
+{
+ hal::nowUs=0;
+ hal::epochBase=SIM_EPOCH;
+ hal::serialCapture=false;
+ hal::humidity=60;
+ hal::airTemp=roomAt(p,0);
+ hal::waterTemp=p.start;
+
+ v4::setup();
+
+ if(autoTune)
+ v4::server.request("/api/tune",{{"enable","1"},{"target",std::to_string(p.target)}});
+
+ const double c=p.liters*4186.0;
+ const double cZone=c*0.1;
+ const double cBulk=c-cZone;
+
+ const uint64_t endUs=(uint64_t)(p.hours*3600e6);
+ const uint64_t lastDayUs=p.hours>24?endUs-86400000000ULL:0;
+
+ double zone=p.start,bulk=p.start;
+ uint64_t simUs=0;
+ bool heater=false,fan=false;
+
+ std::mt19937 rng(p.seed);
+ std::normal_distribution<double> noise(0.0,p.noise);
+
+ Result r;
+
+ while(hal::nowUs<endUs)
+ {
+  // 1초 단위로 모델을 펌웨어 시각까지 진행
+  while(simUs+1000000ULL<=hal::nowUs)
+  {
+   double room=roomAt(p,simUs/1e6);
+
+   bool h=hal::pinLevel[PIN_HEATER]==HIGH;
+   bool f=hal::pinLevel[PIN_FAN]==HIGH;
+
+   if(h && !heater)
+   {
+    r.heaterCycles++;
+    if(simUs>=lastDayUs) r.heaterCyclesLast++;
+   }
+   if(f && !fan) r.fanCycles++;
+   heater=h;
+   fan=f;
+
+   double heat=heater?p.heaterW:0;
+   double cool=fan?p.fanW:0;
+   double mix=p.mixWK*(zone-bulk);
+
+   zone+=(heat-mix)/cZone;
+   bulk+=(mix-p.lossWK*(bulk-room)-cool)/cBulk;
+
+   r.energyWh+=(heat+(fan?v4::RELAY_WATTS[v4::RID_FAN]:0))/3600.0;
+   r.tMin=std::min(r.tMin,bulk);
+   r.tMax=std::max(r.tMax,bulk);
+   if(bulk<v4::HEATER_ON/100.0-0.25 || bulk>v4::FAN_ON/100.0+0.25) r.outSec++;
+
+   simUs+=1000000ULL;
+
+   hal::airTemp=room;
+   hal::waterTemp=floor((bulk+noise(rng))*16)/16;
+  }
+
+  v4::loop();
+  hal::nowUs+=p.tickMs*1000ULL;
+ }
+
+ double hours=p.hours;
+ double lastHours=std::min(24.0,hours);
+
+ char hb[12],fb[12];
+ v4::fmtFixed(hb,v4::heaterOffAt,2,2);
+ v4::fmtFixed(fb,v4::fanOffAt,2,2);
+
+ printf("%-6s %7.2f %7.2f %7.2f %9.1f %6.2f %6.2f %6.2f %10s %7s %4u\n",autoTune?"auto":"fixed",
+ r.heaterCycles/hours,r.heaterCyclesLast/lastHours,r.fanCycles/hours,r.energyWh,r.tMin,r.tMax,
+ 100.0*r.outSec/(hours*3600),hb,fb,v4::tune.adjustments);
+
+ // 재부팅 후에도 남는지: NVS 에 저장된 값을 다시 읽는다
+ if(autoTune)
+ {
+  v4::TuneStore st;
+  Preferences nvs;
+  nvs.begin("farm",true);
+
+  if(nvs.getBytes("tune",&st,sizeof(st))==sizeof(st))
+  {
+   v4::fmtFixed(hb,st.heaterOff,2,2);
+   v4::fmtFixed(fb,st.fanOff,2,2);
+   printf("       nvs: enabled=%u target=%u heater_off=%s fan_off=%s\n",st.enabled,st.targetCph,hb,fb);
+  }
+ }
+}
+
+int main(int argc,char** argv)
+{
+ Params p;
+
+ for(int i=1;i<argc;i++)
+ {
+  std::string opt=argv[i];
+
+  if(i+1>=argc)
+  {
+   fprintf(stderr,"usage: %s [--liters L] [--heater W] [--loss W/K] [--room C] [--swing C] [--noise C]"
+   " [--hours H] [--target cph] [--tick ms] [--seed n]\n",argv[0]);
+   return 2;
+  }
+
+  double v=atof(argv[++i]);
+
+  if(opt=="--liters") p.liters=v;
+  else if(opt=="--heater") p.heaterW=v;
+  else if(opt=="--loss") p.lossWK=v;
+  else if(opt=="--room") p.room=v;
+  else if(opt=="--swing") p.swing=v;
+  else if(opt=="--noise") p.noise=v;
+  else if(opt=="--hours") p.hours=v;
+  else if(opt=="--target") p.target=(int)v;
+  else if(opt=="--tick") p.tickMs=(uint32_t)v;
+  else if(opt=="--seed") p.seed=(uint32_t)v;
+  else
+  {
+   fprintf(stderr,"unknown option %s\n",opt.c_str());
+   return 2;
+  }
+ }
+
+ printf("tank: %.0f L, heater %.0f W, loss %.1f W/K, room %.1f+-%.1f C, noise %.2f C, %.0f h, target %d cycles/h\n\n",
+ p.liters,p.heaterW,p.lossWK,p.room,p.swing,p.noise,p.hours,p.target);
+ printf("%-6s %7s %7s %7s %9s %6s %6s %6s %10s %7s %4s\n",
+ "mode","heater","last24","fan","energy_Wh","min","max","out_%","heater_off","fan_off","adj");
+ fflush(stdout);
+
+ for(int m=0;m<2;m++)
+ {
+  pid_t pid=fork();
+
+  if(pid==0)
+  {
+   simulate(p,m==1);
+   fflush(stdout);
+   _exit(0);
+  }
+
+  int status;
+  waitpid(pid,&status,0);
+ }
+
+ return 0;
+}
@@ -0,0 +1,428 @@
+// 센서 트레이스 재생기 (호스트)
+//
+// 장치의 /api/trace 로 받은 트레이스(farm-trace v1)를 fish_plant_01~04 제어 로직에
+// 똑같이 흘려 넣고, 버전별 릴레이 타임라인을 비교한다.
+// 각 스케치는 호스트 HAL(tools/host)로 수정 없이 컴파일되며, 가상 시간을 tick 단위로
+// 진행시키면서 트레이스의 센서값을 HAL 센서에 반영한다. 같은 트레이스는 항상 같은 결과를 낸다.
+//
+// 빌드: g++ -O2 -std=gnu++17 -Itools/host -include Arduino.h tools/trace_replay.cpp -o trace_replay
+// 실행: ./trace_replay trace.txt [--versions 1,2,3,4] [--tick 100] [--diff rec]
+//                             [--watts heater=300,fan=5,led=20,pump=10]
+//
+// 출력
+//  - 버전별 릴레이 ON 시간, 전환 횟수, 에너지(Wh)
+//  - 온도 오차: 수온이 히터 기준(22.0) 미만인데 히터 OFF / 팬 기준(26.0) 초과인데 팬 OFF 였던 시간
+//  - 타임라인 diff: 기준(--diff, 기본은 트레이스에 기록된 릴레이 rec, 없으면 v4)과 상태가 다른 시간
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "host.h"
+
+#define PERF_ENABLE 0
+
+// 재생은 네트워크 없이 결정적으로 돈다. -DMQTT_ENABLE=1 -DMQTT_HOST=\"127.0.0.1\" 로 빌드하면 v4 가
+// 재생 중 발행하는 메시지를 로컬 브로커(tools/mqtt_broker.cpp)로 받아 볼 수 있다.
+#ifndef MQTT_ENABLE
+#define MQTT_ENABLE 0
+#endif
+
+namespace v1
+{
+#include "../fish_plant_01.cpp"
+}
+
+namespace v2
+{
+#include "../fish_plant_02.cpp"
+}
+
+namespace v3
+{
+#include "../fish_plant_03.cpp"
+}
+
+namespace v4
+{
+#include "../fish_plant_04.cpp"
+}
+
+#if MQTT_ENABLE
+// v4 는 브로커 연결을 별도 태스크에서 맺는다. 연결/CONNACK 은 실제 시간이 걸리므로 그동안 재생 시계를
+// 세워 두고, 재생이 끝나면 큐가 빌 때까지 보낸다 (각각 최대 2초/5초).
+static void mqttWaitConnect()
+{
+ for(int i=0;i<2000 && (v4::mqttState==v4::MS_CONNECTING || v4::mqttState==v4::MS_WAIT_CONNACK);i++)
+ {
+  usleep(1000);
+  v4::handleMqtt();
+ }
+}
+
+static void mqttDrain()
+{
+ for(int i=0;i<5000 && v4::mqttUsed;i++)
+ {
+  hal::nowUs+=1000;
+  v4::handleMqtt();
+  mqttWaitConnect();
+  usleep(1000);
+ }
+}
+#endif
+
+static const uint8_t PINS[4]={14,25,26,33};
+static const char* const NAMES[4]={"heater","fan","led","pump"};
+
+// 수온 제어 기준 (온도 오차 계산용)
+static const float BAND_LOW=22.0f;
+static const float BAND_HIGH=26.0f;
+
+struct Version
+{
+ const char* name;
+ void (*setup)();
+ void (*loop)();
+ bool activeLow;
+};
+
+static const Version VERSIONS[]=
+{
+ {"v1",v1::setup,v1::loop,true},
+ {"v2",v2::setup,v2::loop,true},
+ {"v3",v3::setup,v3::loop,false},
+ {"v4",v4::setup,v4::loop,false},
+};
+
+// ---------------- 트레이스 ----------------
+struct Sample
+{
+ uint32_t ms;
+ float air;
+ float hum;
+ float water;
+};
+
+struct Edge
+{
+ uint32_t ms;
+ int relay;
+ bool on;
+};
+
+struct Trace
+{
+ uint32_t epoch=0;
+ uint32_t epochMs=0;
+ std::vector<Sample> samples;
+ std::vector<Edge> relays;
+};
+
+static float parseValue(const std::string& s)
+{
+ if(s=="nan") return NAN;
+ return strtof(s.c_str(),nullptr);
+}
+
+static int relayIndex(const std::string& name)
+{
+ for(int i=0;i<4;i++)
+ if(name==NAMES[i]) return i;
+ return -1;
+}
+
+static bool loadTrace(std::istream& in,Trace& tr)
+{
+ std::string line;
+
+ while(std::getline(in,line))
+ {
+  if(line.empty()) continue;
+
+  if(line[0]=='#')
+  {
+   size_t e=line.find("epoch=");
+   size_t m=line.find("ms=");
+   if(e!=std::string::npos) tr.epoch=strtoul(line.c_str()+e+6,nullptr,10);
+   if(m!=std::string::npos) tr.epochMs=strtoul(line.c_str()+m+3,nullptr,10);
+   continue;
+  }
+
+  std::vector<std::string> f;
+  std::stringstream ss(line);
+  std::string tok;
+  while(std::getline(ss,tok,',')) f.push_back(tok);
+
+  if(f[0]=="S" && f.size()==5)
+  tr.samples.push_back({(uint32_t)strtoul(f[1].c_str(),nullptr,10),parseValue(f[2]),parseValue(f[3]),parseValue(f[4])});
+  else if(f[0]=="R" && f.size()==4 && relayIndex(f[2])>=0)
+  tr.relays.push_back({(uint32_t)strtoul(f[1].c_str(),nullptr,10),relayIndex(f[2]),f[3]=="1"});
+  else
+  {
+   fprintf(stderr,"bad trace line: %s\n",line.c_str());
+   return false;
+  }
+ }
+
+ return !tr.samples.empty();
+}
+
+// ---------------- 타임라인 ----------------
+// 릴레이별 상태 변화 목록. 시작 상태는 OFF.
+struct Timeline
+{
+ std::string name;
+ std::vector<Edge> edges[4];
+
+ void add(uint32_t ms,int relay,bool on)
+ {
+  std::vector<Edge>& e=edges[relay];
+  bool cur=e.empty()?false:e.back().on;
+  if(on!=cur) e.push_back({ms,relay,on});
+ }
+
+ bool at(int relay,uint32_t ms) const
+ {
+  bool on=false;
+  for(const Edge& e:edges[relay])
+  {
+   if(e.ms>ms) break;
+   on=e.on;
+  }
+  return on;
+ }
+};
+
+static Timeline replay(const Version& v,const Trace& tr,uint32_t tickMs)
+{
+ uint32_t start=tr.samples.front().ms;
+ uint32_t end=tr.samples.back().ms;
+
+ hal::nowUs=(uint64_t)start*1000ULL;
+ hal::epochBase=tr.epoch?tr.epoch-tr.epochMs/1000:hal::epochBase;
+ hal::pinWrites.clear();
+ hal::serialOut.clear();
+ hal::serialCapture=false;
+
+ size_t k=0;
+
+ auto applySamples=[&]()
+ {
+  while(k<tr.samples.size() && tr.samples[k].ms<=millis())
+  {
+   const Sample& s=tr.samples[k++];
+   hal::airTemp=s.air;
+   hal::humidity=s.hum;
+   hal::waterTemp=isnan(s.water)?DEVICE_DISCONNECTED_C:s.water;
+  }
+ };
+
+ applySamples();
+ v.setup();
+
+ for(uint64_t t=start;t<=end;t+=tickMs)
+ {
+  if(hal::nowUs<t*1000ULL) hal::nowUs=t*1000ULL;
+  applySamples();
+  v.loop();
+
+  #if MQTT_ENABLE
+  if(v.loop==v4::loop) mqttWaitConnect();
+  #endif
+ }
+
+ #if MQTT_ENABLE
+ if(v.loop==v4::loop) mqttDrain();
+ #endif
+
+ Timeline tl;
+ tl.name=v.name;
+
+ for(const hal::PinWrite& w:hal::pinWrites)
+ for(int i=0;i<4;i++)
+ if(w.pin==PINS[i])
+ tl.add((uint32_t)(w.us/1000ULL),i,v.activeLow?w.level==LOW:w.level==HIGH);
+
+ return tl;
+}
+
+// ---------------- 지표 ----------------
+struct Report
+{
+ double onSec[4]={0};
+ int transitions[4]={0};
+ double energyWh=0;
+ double coldSec=0;    // 수온 < BAND_LOW 인데 히터 OFF
+ double hotSec=0;     // 수온 > BAND_HIGH 인데 팬 OFF
+};
+
+static Report evaluate(const Timeline& tl,const Trace& tr,const double watts[4])
+{
+ Report r;
+
+ uint32_t start=tr.samples.front().ms;
+ uint32_t end=tr.samples.back().ms;
+
+ for(int i=0;i<4;i++)
+ {
+  bool on=false;
+  uint32_t since=start;
+
+  for(const Edge& e:tl.edges[i])
+  {
+   uint32_t t=std::min(std::max(e.ms,start),end);
+   if(on) r.onSec[i]+=(t-since)/1000.0;
+   on=e.on;
+   since=t;
+   r.transitions[i]++;
+  }
+
+  if(on) r.onSec[i]+=(end-since)/1000.0;
+
+  r.energyWh+=watts[i]*r.onSec[i]/3600.0;
+ }
+
+ for(size_t k=0;k+1<tr.samples.size();k++)
+ {
+  const Sample& s=tr.samples[k];
+  double dt=(tr.samples[k+1].ms-s.ms)/1000.0;
+
+  if(isnan(s.water)) continue;
+
+  if(s.water<BAND_LOW && !tl.at(0,s.ms)) r.coldSec+=dt;
+  if(s.water>BAND_HIGH && !tl.at(1,s.ms)) r.hotSec+=dt;
+ }
+
+ return r;
+}
+
+// 두 타임라인이 서로 다른 상태였던 시간(1초 해상도)과 첫 불일치 시각
+static void printDiff(const Timeline& a,const Timeline& b,const Trace& tr)
+{
+ uint32_t start=tr.samples.front().ms;
+ uint32_t end=tr.samples.back().ms;
+
+ printf("\ndiff %s vs %s\n",a.name.c_str(),b.name.c_str());
+ printf("%-8s %12s %14s\n","relay","differ_s","first_diff_ms");
+
+ for(int i=0;i<4;i++)
+ {
+  uint32_t differ=0;
+  long first=-1;
+
+  for(uint32_t t=start;t<=end;t+=1000)
+  {
+   if(a.at(i,t)==b.at(i,t)) continue;
+   differ++;
+   if(first<0) first=t;
+  }
+
+  if(first<0) printf("%-8s %12u %14s\n",NAMES[i],differ,"-");
+  else printf("%-8s %12u %14ld\n",NAMES[i],differ,first);
+ }
+}
+
+static void parseWatts(const std::string& arg,double watts[4])
+{
+ std::stringstream ss(arg);
+ std::string kv;
+
+ while(std::getline(ss,kv,','))
+ {
+  size_t eq=kv.find('=');
+  if(eq==std::string::npos) continue;
+  int i=relayIndex(kv.substr(0,eq));
+  if(i>=0) watts[i]=atof(kv.c_str()+eq+1);
+ }
+}
+
+int main(int argc,char** argv)
+{
+ if(argc<2)
+ {
+  fprintf(stderr,"usage: %s trace.txt|- [--versions 1,2,3,4] [--tick ms] [--diff rec|vN] [--watts heater=W,...]\n",argv[0]);
+  return 2;
+ }
+
+ std::string path=argv[1];
+ std::string versions="1,2,3,4";
+ std::string diffBase;
+ uint32_t tickMs=100;
+ double watts[4]={300,5,20,10};
+
+ for(int i=2;i+1<argc;i+=2)
+ {
+  std::string opt=argv[i];
+  if(opt=="--versions") versions=argv[i+1];
+  else if(opt=="--tick") tickMs=atoi(argv[i+1]);
+  else if(opt=="--diff") diffBase=argv[i+1];
+  else if(opt=="--watts") parseWatts(argv[i+1],watts);
+ }
+
+ Trace tr;
+ bool ok;
+
+ if(path=="-") ok=loadTrace(std::cin,tr);
+ else
+ {
+  std::ifstream f(path);
+  ok=f && loadTrace(f,tr);
+ }
+
+ if(!ok)
+ {
+  fprintf(stderr,"cannot load trace %s\n",path.c_str());
+  return 1;
+ }
+
+ std::vector<Timeline> lines;
+
+ if(!tr.relays.empty())
+ {
+  Timeline rec;
+  rec.name="rec";
+  for(const Edge& e:tr.relays) rec.add(e.ms,e.relay,e.on);
+  lines.push_back(rec);
+ }
+
+ for(char c:versions)
+ if(c>='1' && c<='4') lines.push_back(replay(VERSIONS[c-'1'],tr,tickMs));
+
+ printf("trace: %zu samples, %zu relay records, %.1f min\n",tr.samples.size(),tr.relays.size(),
+ (tr.samples.back().ms-tr.samples.front().ms)/60000.0);
+
+ printf("\n%-4s","");
+ for(int i=0;i<4;i++) printf(" %9s_s %5s_n",NAMES[i],NAMES[i]);
+ printf(" %9s %8s %8s\n","energy_Wh","cold_s","hot_s");
+
+ for(const Timeline& tl:lines)
+ {
+  Report r=evaluate(tl,tr,watts);
+
+  printf("%-4s",tl.name.c_str());
+  for(int i=0;i<4;i++) printf(" %11.0f %7d",r.onSec[i],r.transitions[i]);
+  printf(" %9.2f %8.0f %8.0f\n",r.energyWh,r.coldSec,r.hotSec);
+ }
+
+ if(diffBase.empty()) diffBase=tr.relays.empty()?"v4":"rec";
+
+ const Timeline* base=nullptr;
+ for(const Timeline& tl:lines)
+ if(tl.name==diffBase) base=&tl;
+
+ if(!base)
+ {
+  fprintf(stderr,"diff base %s not replayed\n",diffBase.c_str());
+  return 1;
+ }
+
+ for(const Timeline& tl:lines)
+ if(&tl!=base) printDiff(tl,*base,tr);
+
+ return 0;
+}
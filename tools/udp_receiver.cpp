@@ -0,0 +1,199 @@
+// UDP 텔레메트리 수신기 (호스트)
+//
+// fish_plant_04 가 브로드캐스트하는 TelemetryPacket 을 받아 해석하고, 장치(송신 주소)별로
+// seq 를 따라가며 유실/중복·역순/재부팅을 센다. 패킷 레이아웃은 스케치의 정의를 그대로 쓴다.
+//
+// 빌드: g++ -O2 -std=gnu++17 -Itools/host -include Arduino.h tools/udp_receiver.cpp -o udp_receiver
+// 실행: ./udp_receiver [--port 47000] [--quiet] [--report 10]
+//
+//  --quiet     패킷마다 출력하지 않음
+//  --report N  N 초마다 장치별 요약 (0=종료 시에만)
+//
+// 유실은 seq 가 건너뛴 수, 재부팅은 uptime 이 줄어든 경우(이때 seq 는 1부터 다시 센다).
+
+#include <string>
+#include <map>
+
+#include <signal.h>
+#include <poll.h>
+#include <arpa/inet.h>
+
+#include "host.h"
+
+#define PERF_ENABLE 0
+#define MQTT_ENABLE 0
+
+namespace v4
+{
+#include "../fish_plant_04.cpp"
+}
+
+using v4::TelemetryPacket;
+
+struct Device
+{
+ unsigned long received=0;
+ unsigned long lost=0;
+ unsigned long stale=0;   // 중복 또는 늦게 온 패킷
+ unsigned long reboots=0;
+ uint32_t lastSeq=0;
+ uint32_t lastUptime=0;
+ bool seen=false;
+};
+
+static volatile sig_atomic_t stopFlag=0;
+
+static void onSignal(int)
+{
+ stopFlag=1;
+}
+
+static void printValue(const char* name,int16_t v,const char* unit)
+{
+ if(v==v4::TELEMETRY_NA) printf(" %s=NA",name);
+ else printf(" %s=%.2f%s",name,v/100.0,unit);
+}
+
+static void report(const std::map<std::string,Device>& devices)
+{
+ printf("\n%-22s %10s %8s %8s %8s %8s\n","device","received","lost","stale","reboots","loss%");
+
+ for(const auto& kv:devices)
+ {
+  const Device& d=kv.second;
+  double total=d.received+d.lost;
+  printf("%-22s %10lu %8lu %8lu %8lu %7.2f%%\n",kv.first.c_str(),d.received,d.lost,d.stale,d.reboots,
+  total?100.0*d.lost/total:0.0);
+ }
+
+ fflush(stdout);
+}
+
+int main(int argc,char** argv)
+{
+ int port=v4::TELEMETRY_PORT;
+ bool quiet=false;
+ int reportSec=0;
+
+ for(int i=1;i<argc;i++)
+ {
+  std::string opt=argv[i];
+  if(opt=="--port" && i+1<argc) port=atoi(argv[++i]);
+  else if(opt=="--report" && i+1<argc) reportSec=atoi(argv[++i]);
+  else if(opt=="--quiet") quiet=true;
+  else
+  {
+   fprintf(stderr,"usage: %s [--port %u] [--quiet] [--report sec]\n",argv[0],v4::TELEMETRY_PORT);
+   return 2;
+  }
+ }
+
+ signal(SIGINT,onSignal);
+ signal(SIGTERM,onSignal);
+
+ int fd=socket(AF_INET,SOCK_DGRAM,0);
+ int one=1;
+ setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+ sockaddr_in addr={};
+ addr.sin_family=AF_INET;
+ addr.sin_port=htons(port);
+ addr.sin_addr.s_addr=htonl(INADDR_ANY);
+
+ if(bind(fd,(sockaddr*)&addr,sizeof(addr))<0)
+ {
+  perror("bind");
+  return 1;
+ }
+
+ fprintf(stderr,"udp_receiver listening on :%d (version %u, %zu bytes)\n",port,v4::TELEMETRY_VERSION,sizeof(TelemetryPacket));
+
+ std::map<std::string,Device> devices;
+ unsigned long badPackets=0;
+ time_t lastReport=time(nullptr);
+
+ while(!stopFlag)
+ {
+  pollfd p={fd,POLLIN,0};
+
+  if(reportSec && time(nullptr)-lastReport>=reportSec)
+  {
+   report(devices);
+   lastReport=time(nullptr);
+  }
+
+  if(poll(&p,1,500)<=0) continue;
+
+  uint8_t buf[512];
+  sockaddr_in from={};
+  socklen_t fromLen=sizeof(from);
+  ssize_t n=recvfrom(fd,buf,sizeof(buf),0,(sockaddr*)&from,&fromLen);
+
+  TelemetryPacket pkt;
+
+  // 버전이 다르거나 크기가 맞지 않으면 해석하지 않는다
+  if(n<(ssize_t)sizeof(pkt))
+  {
+   badPackets++;
+   continue;
+  }
+
+  memcpy(&pkt,buf,sizeof(pkt));
+
+  if(pkt.magic!=v4::TELEMETRY_MAGIC || pkt.version!=v4::TELEMETRY_VERSION || pkt.size!=sizeof(pkt))
+  {
+   badPackets++;
+   continue;
+  }
+
+  char src[32];
+  snprintf(src,sizeof(src),"%s:%u",inet_ntoa(from.sin_addr),ntohs(from.sin_port));
+
+  Device& d=devices[src];
+
+  if(d.seen && pkt.uptimeMs<d.lastUptime)
+  {
+   d.reboots++;
+   d.lastSeq=0;
+  }
+
+  if(d.seen && pkt.seq<=d.lastSeq) d.stale++;
+  else
+  {
+   if(pkt.seq>d.lastSeq+1 && (d.seen || d.lastSeq)) d.lost+=pkt.seq-d.lastSeq-1;
+   d.lastSeq=pkt.seq;
+   d.lastUptime=pkt.uptimeMs;
+  }
+
+  d.received++;
+  d.seen=true;
+
+  if(quiet) continue;
+
+  printf("%s seq=%lu up=%.1fs epoch=%lu",src,(unsigned long)pkt.seq,pkt.uptimeMs/1000.0,(unsigned long)pkt.epoch);
+  printValue("air",pkt.air,"C");
+  printValue("hum",pkt.hum,"%");
+  printValue("water",pkt.water,"C");
+  printf(" pump_rem=%us relays=",pkt.pumpRemain);
+
+  bool any=false;
+  for(int i=0;i<v4::RID_COUNT;i++)
+  if(pkt.relays&(1<<i))
+  {
+   printf("%s%s",any?",":"",v4::RELAY_NAMES[i]);
+   any=true;
+  }
+  if(!any) printf("-");
+
+  for(int i=0;i<v4::ALARM_COUNT;i++)
+  if(pkt.alarms&(1UL<<i)) printf(" ALARM:%s",v4::ALARM_RULES[i].name);
+
+  printf("\n");
+  fflush(stdout);
+ }
+
+ report(devices);
+ if(badPackets) printf("bad packets: %lu\n",badPackets);
+
+ return 0;
+}